@@ -67,6 +67,53 @@
 # define ABI_TYPE  uint32_t
 #endif
 
+#if DATA_SIZE < 16
+/*
+ * atomic_mmu_lookup lets through misaligned operations that fit within
+ * an aligned host word (see atomic_widened_ok); these are performed as
+ * a compare-and-swap loop on that word rather than stopping the world.
+ */
+static inline DATA_TYPE glue(atomic_cas_, SUFFIX)(DATA_TYPE *haddr,
+                                                  DATA_TYPE cmpv,
+                                                  DATA_TYPE newv)
+{
+    if (DATA_SIZE > 1 && unlikely((uintptr_t)haddr & (DATA_SIZE - 1))) {
+        DATA_TYPE oldv;
+
+        atomic_cmpxchg_widened(haddr, &cmpv, &newv, &oldv, DATA_SIZE);
+        return oldv;
+    }
+    return qatomic_cmpxchg__nocheck(haddr, cmpv, newv);
+}
+
+static inline DATA_TYPE glue(atomic_read_, SUFFIX)(DATA_TYPE *haddr)
+{
+    if (DATA_SIZE > 1 && unlikely((uintptr_t)haddr & (DATA_SIZE - 1))) {
+        return glue(atomic_cas_, SUFFIX)(haddr, 0, 0);
+    }
+    return qatomic_read__nocheck(haddr);
+}
+
+# define ATOMIC_MISALIGNED(HADDR) \
+    (DATA_SIZE > 1 && unlikely((uintptr_t)(HADDR) & (DATA_SIZE - 1)))
+
+/* Compute NEW from OLD with EXPR and store it, for misaligned HADDR. */
+# define ATOMIC_RMW_LOOP(HADDR, OLD, NEW, EXPR)                     \
+    do {                                                            \
+        DATA_TYPE cmp_ = glue(atomic_read_, SUFFIX)(HADDR);         \
+        do {                                                        \
+            OLD = cmp_;                                             \
+            NEW = (EXPR);                                           \
+            cmp_ = glue(atomic_cas_, SUFFIX)(HADDR, OLD, NEW);      \
+        } while (cmp_ != OLD);                                      \
+    } while (0)
+
+# define ADD(X, Y)  ((X) + (Y))
+# define AND(X, Y)  ((X) & (Y))
+# define OR(X, Y)   ((X) | (Y))
+# define XOR(X, Y)  ((X) ^ (Y))
+#endif
+
 /* Define host-endian atomic operations.  Note that END is used within
    the ATOMIC_NAME macro, and redefined below.  */
 #if DATA_SIZE == 1
@@ -88,7 +135,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, cmpv, newv);
 #else
-    ret = qatomic_cmpxchg__nocheck(haddr, cmpv, newv);
+    ret = glue(atomic_cas_, SUFFIX)(haddr, cmpv, newv);
 #endif
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr,
@@ -106,9 +153,13 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
 {
     DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
                                          DATA_SIZE, retaddr);
-    DATA_TYPE ret;
+    DATA_TYPE ret, new;
 
-    ret = qatomic_xchg__nocheck(haddr, val);
+    if (ATOMIC_MISALIGNED(haddr)) {
+        ATOMIC_RMW_LOOP(haddr, ret, new, val);
+    } else {
+        ret = qatomic_xchg__nocheck(haddr, val);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr,
                           VALUE_LOW(ret),
@@ -119,13 +170,18 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
     return ret;
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
-    DATA_TYPE *haddr, ret;                                          \
+    DATA_TYPE *haddr, ret, old, new;                                \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
-    ret = qatomic_##X(haddr, val);                                  \
+    if (ATOMIC_MISALIGNED(haddr)) {                                 \
+        ATOMIC_RMW_LOOP(haddr, old, new, FN(old, val));             \
+        ret = RET;                                                  \
+    } else {                                                        \
+        ret = qatomic_##X(haddr, val);                              \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr,                                \
                           VALUE_LOW(ret),                           \
@@ -136,14 +192,14 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     return ret;                                                     \
 }
 
-GEN_ATOMIC_HELPER(fetch_add)
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(add_fetch)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_add, ADD, old)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(add_fetch, ADD, new)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -162,10 +218,10 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     XDATA_TYPE *haddr, cmp, old, new, val = xval;                   \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
     smp_mb();                                                       \
-    cmp = qatomic_read__nocheck(haddr);                             \
+    cmp = glue(atomic_read_, SUFFIX)((DATA_TYPE *)haddr);           \
     do {                                                            \
         old = cmp; new = FN(old, val);                              \
-        cmp = qatomic_cmpxchg__nocheck(haddr, old, new);            \
+        cmp = glue(atomic_cas_, SUFFIX)((DATA_TYPE *)haddr, old, new); \
     } while (cmp != old);                                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr,                                \
@@ -213,7 +269,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, BSWAP(cmpv), BSWAP(newv));
 #else
-    ret = qatomic_cmpxchg__nocheck(haddr, BSWAP(cmpv), BSWAP(newv));
+    ret = glue(atomic_cas_, SUFFIX)(haddr, BSWAP(cmpv), BSWAP(newv));
 #endif
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr,
@@ -231,9 +287,13 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
 {
     DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
                                          DATA_SIZE, retaddr);
-    ABI_TYPE ret;
+    DATA_TYPE ret, new;
 
-    ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    if (ATOMIC_MISALIGNED(haddr)) {
+        ATOMIC_RMW_LOOP(haddr, ret, new, BSWAP(val));
+    } else {
+        ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr,
                           VALUE_LOW(ret),
@@ -244,13 +304,18 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
     return BSWAP(ret);
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
-    DATA_TYPE *haddr, ret;                                          \
+    DATA_TYPE *haddr, ret, old, new;                                \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
-    ret = qatomic_##X(haddr, BSWAP(val));                           \
+    if (ATOMIC_MISALIGNED(haddr)) {                                 \
+        ATOMIC_RMW_LOOP(haddr, old, new, FN(old, BSWAP(val)));      \
+        ret = RET;                                                  \
+    } else {                                                        \
+        ret = qatomic_##X(haddr, BSWAP(val));                       \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr,                                \
                           VALUE_LOW(ret),                           \
@@ -261,12 +326,12 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     return BSWAP(ret);                                              \
 }
 
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -284,10 +349,10 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     XDATA_TYPE *haddr, ldo, ldn, old, new, val = xval;              \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
     smp_mb();                                                       \
-    ldn = qatomic_read__nocheck(haddr);                             \
+    ldn = glue(atomic_read_, SUFFIX)((DATA_TYPE *)haddr);           \
     do {                                                            \
         ldo = ldn; old = BSWAP(ldo); new = FN(old, val);            \
-        ldn = qatomic_cmpxchg__nocheck(haddr, ldo, BSWAP(new));     \
+        ldn = glue(atomic_cas_, SUFFIX)((DATA_TYPE *)haddr, ldo, BSWAP(new)); \
     } while (ldo != ldn);                                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr,                                \
@@ -311,10 +376,8 @@ GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new)
 
 /* Note that for addition, we need to use a separate cmpxchg loop instead
    of bswaps for the reverse-host-endian helpers.  */
-#define ADD(X, Y)   (X + Y)
 GEN_ATOMIC_HELPER_FN(fetch_add, ADD, DATA_TYPE, old)
 GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
-#undef ADD
 
 #undef GEN_ATOMIC_HELPER_FN
 #endif /* DATA_SIZE < 16 */
@@ -322,6 +385,15 @@ GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
 #undef END
 #endif /* DATA_SIZE > 1 */
 
+#if DATA_SIZE < 16
+#undef ATOMIC_MISALIGNED
+#undef ATOMIC_RMW_LOOP
+#undef ADD
+#undef AND
+#undef OR
+#undef XOR
+#endif
+
 #undef BSWAP
 #undef ABI_TYPE
 #undef DATA_TYPE
@@ -245,6 +245,14 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+/* Lookup statistics for "info jit", only kept with tb-lookup-stats=on */
+static inline void tb_lookup_count(size_t *counter)
+{
+    if (unlikely(qatomic_read(&tb_lookup_stats_enabled))) {
+        qatomic_set(counter, *counter + 1);
+    }
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                                           uint64_t cs_base, uint32_t flags,
@@ -266,14 +274,17 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                tb->cs_base == cs_base &&
                tb->flags == flags &&
                tb_cflags(tb) == cflags)) {
+        tb_lookup_count(&jc->lookup_hit);
         goto hit;
     }
 
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
+        tb_lookup_count(&jc->lookup_miss);
         return NULL;
     }
 
+    tb_lookup_count(&jc->lookup_htable);
     jc->array[hash].pc = pc;
     qatomic_set(&jc->array[hash].tb, tb);
 
@@ -401,11 +412,14 @@ static inline bool check_for_breakpoints(CPUState *cpu, vaddr pc,
 const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 {
     CPUState *cpu = env_cpu(env);
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
     TranslationBlock *tb;
     vaddr pc;
     uint64_t cs_base;
     uint32_t flags, cflags;
 
+    tb_lookup_count(&jc->indirect_count);
+
     /*
      * By definition we've just finished a TB, so I/O is OK.
      * Avoid the possibility of calling cpu_io_recompile() if
@@ -423,6 +437,7 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
+        tb_lookup_count(&jc->indirect_exit);
         return tcg_code_gen_epilogue;
     }
 
@@ -458,6 +473,7 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
     ret = tcg_qemu_tb_exec(cpu_env(cpu), tb_ptr);
     cpu->neg.can_do_io = true;
     qemu_plugin_disable_mem_helpers(cpu);
+    qemu_plugin_tb_exit(cpu);
     /*
      * TODO: Delay swapping back to the read-write region of the TB
      * until we actually need to modify the TB.  The read-only copy,
@@ -1013,6 +1029,14 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
             if (tb_page_addr1(tb) != -1) {
                 last_tb = NULL;
             }
+            /*
+             * Temporary TBs are not tracked in the region trees, so
+             * tb_evict() could not undo a jump to or from one of them.
+             */
+            if (tb_page_addr0(tb) == -1 ||
+                (last_tb && tb_page_addr0(last_tb) == -1)) {
+                last_tb = NULL;
+            }
 #endif
             /* See if we can patch the calling TB. */
             if (last_tb) {
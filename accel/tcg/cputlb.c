@@ -507,23 +507,120 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/*
+ * Our TLB maps large pages with one entry per target page, recording the
+ * size in CPUTLBEntryFull.lg_page_size.  Remember the area covered by
+ * large pages, so that flushes outside it can use the page index alone.
+ */
+static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
+                               vaddr addr, uint64_t size)
+{
+    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
+    vaddr lp_mask = ~(size - 1);
+
+    if (lp_addr == (vaddr)-1) {
+        /* No previous large page.  */
+        lp_addr = addr;
+    } else {
+        /* Extend the existing region to include the new page.  */
+        lp_mask &= cpu->neg.tlb.d[mmu_idx].large_page_mask;
+        while (((lp_addr ^ addr) & lp_mask) != 0) {
+            lp_mask <<= 1;
+        }
+    }
+    cpu->neg.tlb.d[mmu_idx].large_page_addr = lp_addr & lp_mask;
+    cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
+}
+
+/* Return the target page mapped by @te, or -1 if no access is valid. */
+static vaddr tlb_entry_page(const CPUTLBEntry *te)
+{
+    for (int i = 0; i < MMU_ACCESS_COUNT; i++) {
+        uint64_t cmp = te->addr_idx[i];
+
+        if (!(cmp & TLB_INVALID_MASK)) {
+            return cmp & TARGET_PAGE_MASK;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Flush @te if it belongs to a large page overlapping [@addr, @addr + @len)
+ * under @mask, otherwise add it back to the large page region.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_entry_locked(CPUState *cpu, int midx,
+                                         CPUTLBEntry *te,
+                                         const CPUTLBEntryFull *full,
+                                         vaddr addr, vaddr len, vaddr mask)
+{
+    int lg = full->lg_page_size;
+    vaddr page, base, size;
+
+    if (lg <= TARGET_PAGE_BITS) {
+        return;
+    }
+    page = tlb_entry_page(te);
+    if (page == (vaddr)-1) {
+        return;
+    }
+
+    size = (vaddr)1 << lg;
+    base = page & ~(size - 1) & mask;
+    if (base <= addr + len - 1 && addr <= base + size - 1) {
+        memset(te, -1, sizeof(*te));
+        tlb_n_used_entries_dec(cpu, midx);
+    } else {
+        tlb_add_large_page(cpu, midx, page, size);
+    }
+}
+
+/*
+ * Flush every entry whose large page overlaps [@addr, @addr + @len),
+ * leaving the rest of the tlb intact, and recompute the large page
+ * region from the surviving entries.  Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_pages_locked(CPUState *cpu, int midx,
+                                         vaddr addr, vaddr len, vaddr mask)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    size_t i, n = tlb_n_entries(f);
+
+    tlb_debug("large page flush midx %d (%016" VADDR_PRIx "+%016"
+              VADDR_PRIx ")\n", midx, addr, len);
+
+    d->large_page_addr = -1;
+    d->large_page_mask = -1;
+    addr &= mask;
+
+    for (i = 0; i < n; i++) {
+        tlb_flush_large_entry_locked(cpu, midx, &f->table[i], &d->fulltlb[i],
+                                     addr, len, mask);
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        tlb_flush_large_entry_locked(cpu, midx, &d->vtable[i],
+                                     &d->vfulltlb[i], addr, len, mask);
+    }
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
     vaddr lp_mask = cpu->neg.tlb.d[midx].large_page_mask;
 
-    /* Check if we need to flush due to large pages.  */
+    /*
+     * Flushing any part of a large page flushes all of it, and its other
+     * target pages live at other indexes; find them by walking the tlb.
+     */
     if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d (%016"
-                  VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
-            tlb_n_used_entries_dec(cpu, midx);
-        }
-        tlb_flush_vtlb_page_locked(cpu, midx, page);
+        tlb_flush_large_pages_locked(cpu, midx, page, TARGET_PAGE_SIZE, -1);
+    }
+    if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+        tlb_n_used_entries_dec(cpu, midx);
     }
+    tlb_flush_vtlb_page_locked(cpu, midx, page);
 }
 
 /**
@@ -700,11 +797,7 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
      * we only need to test the end of the range.
      */
     if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-        return;
+        tlb_flush_large_pages_locked(cpu, midx, addr, len, mask);
     }
 
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
@@ -985,30 +1078,6 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
-static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
-                               vaddr addr, uint64_t size)
-{
-    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
-    vaddr lp_mask = ~(size - 1);
-
-    if (lp_addr == (vaddr)-1) {
-        /* No previous large page.  */
-        lp_addr = addr;
-    } else {
-        /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= cpu->neg.tlb.d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ addr) & lp_mask) != 0) {
-            lp_mask <<= 1;
-        }
-    }
-    cpu->neg.tlb.d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
-}
-
 static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
                                    vaddr address, int flags,
                                    MMUAccessType access_type, bool enable)
@@ -1791,8 +1860,8 @@ static bool mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
 }
 
 /*
- * Probe for an atomic operation.  Do not allow unaligned operations,
- * or io operations to proceed.  Return the host address.
+ * Probe for an atomic operation.  Do not allow io operations, or unaligned
+ * operations that cannot be widened, to proceed.  Return the host address.
  */
 static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
                                int size, uintptr_t retaddr)
@@ -1851,12 +1920,13 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     }
 
     /* Enforce qemu required alignment.  */
-    if (unlikely(addr & (size - 1))) {
+    if (unlikely(addr & (size - 1)) && !atomic_widened_ok(addr, size)) {
         /*
          * We get here if guest alignment was not requested, or was not
          * enforced by cpu_unaligned_access or tlb_fill_align above.
-         * We might widen the access and emulate, but for now
-         * mark an exception and exit the cpu loop.
+         * If the access fits within an aligned host word, the atomic
+         * helpers widen it; otherwise mark an exception and exit the
+         * cpu loop.
          */
         goto stop_the_world;
     }
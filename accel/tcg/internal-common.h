@@ -16,6 +16,8 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern bool tb_exec_count_enabled;
+extern bool tb_lookup_stats_enabled;
 
 /*
  * Return true if CS is not running in parallel with other cpus, either
@@ -49,6 +51,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
+void tb_evict(CPUState *cpu);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
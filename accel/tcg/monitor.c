@@ -19,6 +19,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -46,10 +47,20 @@ static void dump_accel_info(GString *buf)
     bool one_insn_per_tb = object_property_get_bool(OBJECT(accel),
                                                     "one-insn-per-tb",
                                                     &error_fatal);
+    bool tb_exec_count = object_property_get_bool(OBJECT(accel),
+                                                  "tb-exec-count",
+                                                  &error_fatal);
+    bool tb_lookup_stats = object_property_get_bool(OBJECT(accel),
+                                                    "tb-lookup-stats",
+                                                    &error_fatal);
 
     g_string_append_printf(buf, "Accelerator settings:\n");
-    g_string_append_printf(buf, "one-insn-per-tb: %s\n\n",
+    g_string_append_printf(buf, "one-insn-per-tb: %s\n",
                            one_insn_per_tb ? "on" : "off");
+    g_string_append_printf(buf, "tb-exec-count: %s\n",
+                           tb_exec_count ? "on" : "off");
+    g_string_append_printf(buf, "tb-lookup-stats: %s\n\n",
+                           tb_lookup_stats ? "on" : "off");
 }
 
 static void print_qht_statistics(struct qht_stats hst, GString *buf)
@@ -126,6 +137,66 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+#define TB_HOT_LIST_LEN 10
+
+struct tb_hot_list {
+    const TranslationBlock *tb[TB_HOT_LIST_LEN];
+    uint64_t count[TB_HOT_LIST_LEN];
+    int n;
+};
+
+/* Keep the TB_HOT_LIST_LEN most executed TBs, sorted by decreasing count */
+static gboolean tb_hot_list_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    struct tb_hot_list *hot = data;
+    uint64_t count = tb->exec_count;
+    int i;
+
+    if (!count) {
+        return false;
+    }
+    if (hot->n == TB_HOT_LIST_LEN) {
+        if (count <= hot->count[TB_HOT_LIST_LEN - 1]) {
+            return false;
+        }
+        hot->n--;
+    }
+    for (i = hot->n; i > 0 && hot->count[i - 1] < count; i--) {
+        hot->tb[i] = hot->tb[i - 1];
+        hot->count[i] = hot->count[i - 1];
+    }
+    hot->tb[i] = tb;
+    hot->count[i] = count;
+    hot->n++;
+    return false;
+}
+
+static void dump_hot_tbs(GString *buf)
+{
+    struct tb_hot_list hot = {};
+    int i;
+
+    if (!qatomic_read(&tb_exec_count_enabled)) {
+        return;
+    }
+
+    tcg_tb_foreach(tb_hot_list_iter, &hot);
+    g_string_append_printf(buf, "\nHottest TBs:\n");
+    for (i = 0; i < hot.n; i++) {
+        const TranslationBlock *tb = hot.tb[i];
+
+        if (tb->cflags & CF_PCREL) {
+            g_string_append_printf(buf, "  phys 0x%016" PRIx64,
+                                   (uint64_t)tb->page_addr[0]);
+        } else {
+            g_string_append_printf(buf, "  pc   0x%016" VADDR_PRIx, tb->pc);
+        }
+        g_string_append_printf(buf, " exec %-12" PRIu64 " insns %u\n",
+                               hot.count[i], tb->icount);
+    }
+}
+
 static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
 {
     CPUState *cpu;
@@ -141,6 +212,57 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+struct tb_lookup_stats {
+    size_t hit;
+    size_t htable;
+    size_t miss;
+    size_t indirect;
+    size_t indirect_exit;
+};
+
+static void tb_lookup_counts(struct tb_lookup_stats *st)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (!jc) {
+            continue;
+        }
+        st->hit += qatomic_read(&jc->lookup_hit);
+        st->htable += qatomic_read(&jc->lookup_htable);
+        st->miss += qatomic_read(&jc->lookup_miss);
+        st->indirect += qatomic_read(&jc->indirect_count);
+        st->indirect_exit += qatomic_read(&jc->indirect_exit);
+    }
+}
+
+static void dump_lookup_info(GString *buf)
+{
+    struct tb_lookup_stats lst = {};
+    size_t lookups;
+
+    if (!qatomic_read(&tb_lookup_stats_enabled)) {
+        return;
+    }
+
+    tb_lookup_counts(&lst);
+    lookups = lst.hit + lst.htable + lst.miss;
+    g_string_append_printf(buf, "TB lookups          %zu "
+                           "(jmp cache %zu%%, hash table %zu%%, miss %zu%%)\n",
+                           lookups,
+                           lookups ? (lst.hit * 100) / lookups : 0,
+                           lookups ? (lst.htable * 100) / lookups : 0,
+                           lookups ? (lst.miss * 100) / lookups : 0);
+    g_string_append_printf(buf, "indirect jumps      %zu "
+                           "(%zu%% stayed in generated code)\n",
+                           lst.indirect,
+                           lst.indirect ?
+                           ((lst.indirect - lst.indirect_exit) * 100) /
+                           lst.indirect : 0);
+}
+
 static void tcg_dump_info(GString *buf)
 {
     g_string_append_printf(buf, "[TCG profiler not compiled]\n");
@@ -189,6 +311,8 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
@@ -196,6 +320,9 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    dump_lookup_info(buf);
+    dump_hot_tbs(buf);
     tcg_dump_info(buf);
 }
 
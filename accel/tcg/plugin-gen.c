@@ -212,6 +212,95 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
+static void gen_mem_trace_drain(struct qemu_plugin_trace_cb *cb)
+{
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(qemu_plugin_mem_trace_drain, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->trace)));
+    tcg_temp_free_i32(cpu_index);
+}
+
+/*
+ * Append a record to the vCPU's trace buffer.  Generated code is only left
+ * here if the buffer is full, the records are otherwise handed to the
+ * plugin at the end of the TB.
+ */
+static void gen_mem_trace_cb(struct qemu_plugin_trace_cb *cb,
+                             qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+{
+    struct qemu_plugin_mem_trace *trace = cb->trace;
+    qemu_plugin_u64 count = { .score = trace->score, .offset = 0 };
+    TCGv_ptr buf = gen_plugin_u64_ptr(count);
+    TCGv_ptr rec = tcg_temp_ebb_new_ptr();
+    TCGv_i64 n = tcg_temp_ebb_new_i64();
+    TCGv_i64 ofs = tcg_temp_ebb_new_i64();
+    TCGLabel *not_full = gen_new_label();
+    intptr_t base = offsetof(struct qemu_plugin_mem_trace_buf, records);
+
+    tcg_gen_ld_i64(n, buf, 0);
+    tcg_gen_muli_i64(ofs, n, sizeof(qemu_plugin_mem_record));
+    tcg_gen_trunc_i64_ptr(rec, ofs);
+    tcg_gen_add_ptr(rec, rec, buf);
+    tcg_gen_st_i64(addr, rec, base + offsetof(qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(cb->pc), rec,
+                   base + offsetof(qemu_plugin_mem_record, pc));
+    tcg_gen_st_i32(tcg_constant_i32(meminfo), rec,
+                   base + offsetof(qemu_plugin_mem_record, info));
+    tcg_gen_addi_i64(n, n, 1);
+    tcg_gen_st_i64(n, buf, 0);
+
+    tcg_gen_brcondi_i64(TCG_COND_LTU, n, trace->n_records, not_full);
+    gen_mem_trace_drain(cb);
+    gen_set_label(not_full);
+
+    tcg_temp_free_i64(ofs);
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(buf);
+}
+
+/* Hand the records appended by the TB to the plugin before leaving it */
+static void gen_mem_trace_tb_end(struct qemu_plugin_tb *ptb)
+{
+    g_autoptr(GPtrArray) traces = g_ptr_array_new();
+    size_t i, j;
+
+    for (i = 0; i < ptb->n; i++) {
+        struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, i);
+        GArray *cbs = insn->mem_cbs;
+
+        for (j = 0; j < (cbs ? cbs->len : 0); j++) {
+            struct qemu_plugin_dyn_cb *cb =
+                &g_array_index(cbs, struct qemu_plugin_dyn_cb, j);
+            qemu_plugin_u64 count;
+            TCGv_ptr buf;
+            TCGv_i64 n;
+            TCGLabel *empty;
+
+            if (cb->type != PLUGIN_CB_MEM_TRACE ||
+                g_ptr_array_find(traces, cb->trace.trace, NULL)) {
+                continue;
+            }
+            g_ptr_array_add(traces, cb->trace.trace);
+
+            count.score = cb->trace.trace->score;
+            count.offset = 0;
+            buf = gen_plugin_u64_ptr(count);
+            n = tcg_temp_ebb_new_i64();
+            empty = gen_new_label();
+
+            tcg_gen_ld_i64(n, buf, 0);
+            tcg_gen_brcondi_i64(TCG_COND_EQ, n, 0, empty);
+            gen_mem_trace_drain(&cb->trace);
+            gen_set_label(empty);
+
+            tcg_temp_free_i64(n);
+            tcg_temp_free_ptr(buf);
+        }
+    }
+}
+
 static void inject_cb(struct qemu_plugin_dyn_cb *cb)
 
 {
@@ -249,6 +338,11 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             inject_cb(cb);
         }
         break;
+    case PLUGIN_CB_MEM_TRACE:
+        if (rw & cb->trace.rw) {
+            gen_mem_trace_cb(&cb->trace, meminfo, addr);
+        }
+        break;
     default:
         g_assert_not_reached();
     }
@@ -301,6 +395,7 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 if (plugin_tb->mem_helper) {
                     gen_disable_mem_helper();
                 }
+                gen_mem_trace_tb_end(plugin_tb);
                 break;
 
             case PLUGIN_GEN_AFTER_INSN:
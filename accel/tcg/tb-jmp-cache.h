@@ -28,6 +28,17 @@ typedef struct CPUJumpCache {
         TranslationBlock *tb;
         vaddr pc;
     } array[TB_JMP_CACHE_SIZE];
+
+    /*
+     * Statistics for "info jit", kept only with tb-lookup-stats=on.
+     * Only written by the owning CPU, so plain increments published
+     * with qatomic_set are enough.
+     */
+    size_t lookup_hit;      /* tb_lookup() hits in this cache */
+    size_t lookup_htable;   /* tb_lookup() hits in the QHT */
+    size_t lookup_miss;     /* tb_lookup() misses; needs translation */
+    size_t indirect_count;  /* lookup_tb_ptr calls from generated code */
+    size_t indirect_exit;   /* of which returned to the main loop */
 } CPUJumpCache;
 
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
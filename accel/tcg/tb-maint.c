@@ -799,6 +799,63 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    tb_phys_invalidate(value, -1);
+    return false;
+}
+
+/* evict the oldest region of the code buffer, or flush if there is none */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    CPUState *cs;
+    bool evicted = false;
+
+    mmap_lock();
+    /* A flush requested by another CPU already made room. */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+        goto done;
+    }
+
+    /*
+     * Temporary TBs are not in the region trees, so tb_evict_iter()
+     * cannot reach them; drop them from the jump caches wholesale.
+     */
+    CPU_FOREACH(cs) {
+        tcg_flush_jmp_cache(cs);
+    }
+
+    qemu_thread_jit_write();
+    evicted = tcg_region_evict(tb_evict_iter, NULL);
+    qemu_thread_jit_execute();
+    if (evicted) {
+        qatomic_inc(&tb_ctx.tb_evict_count);
+    }
+
+done:
+    mmap_unlock();
+    if (!evicted) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+/*
+ * Make room for new translations once the code buffer is full.  Unlike
+ * tb_flush(), this only discards the translations of the region that
+ * was filled longest ago, so that the working set survives.
+ */
+void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_serial_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 /* remove @orig from its @n_orig-th jump list */
 static inline void tb_remove_from_jmp_list(TranslationBlock *orig, int n_orig)
 {
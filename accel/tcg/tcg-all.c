@@ -45,6 +45,8 @@ struct TCGState {
 
     bool mttcg_enabled;
     bool one_insn_per_tb;
+    bool tb_exec_count;
+    bool tb_lookup_stats;
     int splitwx_enabled;
     unsigned long tb_size;
 };
@@ -99,6 +101,8 @@ static void tcg_accel_instance_init(Object *obj)
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+bool tb_exec_count_enabled;
+bool tb_lookup_stats_enabled;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -207,6 +211,33 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+static bool tcg_get_tb_exec_count(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_exec_count;
+}
+
+static void tcg_set_tb_exec_count(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_exec_count = value;
+    /* Only affects TBs translated from now on */
+    qatomic_set(&tb_exec_count_enabled, value);
+}
+
+static bool tcg_get_tb_lookup_stats(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_lookup_stats;
+}
+
+static void tcg_set_tb_lookup_stats(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_lookup_stats = value;
+    qatomic_set(&tb_lookup_stats_enabled, value);
+}
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -252,6 +283,18 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+    object_class_property_add_bool(oc, "tb-exec-count",
+                                   tcg_get_tb_exec_count,
+                                   tcg_set_tb_exec_count);
+    object_class_property_set_description(oc, "tb-exec-count",
+        "Count how often each translation block is executed");
+
+    object_class_property_add_bool(oc, "tb-lookup-stats",
+                                   tcg_get_tb_lookup_stats,
+                                   tcg_set_tb_lookup_stats);
+    object_class_property_set_description(oc, "tb-lookup-stats",
+        "Count how translation block lookups are resolved");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -16,6 +16,7 @@
 #include "exec/plugin-gen.h"
 #include "exec/cpu_ldst.h"
 #include "tcg/tcg-op-common.h"
+#include "internal-common.h"
 #include "internal-target.h"
 #include "disas/disas.h"
 
@@ -81,6 +82,15 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
                          - offsetof(ArchCPU, env));
     }
 
+    if (qatomic_read(&tb_exec_count_enabled)) {
+        TCGv_ptr ptr = tcg_constant_ptr(&db->tb->exec_count);
+        TCGv_i64 val = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(val, ptr, 0);
+        tcg_gen_addi_i64(val, val, 1);
+        tcg_gen_st_i64(val, ptr, 0);
+    }
+
     return icount_start_insn;
 }
 
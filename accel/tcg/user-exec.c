@@ -1230,7 +1230,8 @@ uint64_t cpu_ldq_code_mmu(CPUArchState *env, abi_ptr addr,
 #include "ldst_common.c.inc"
 
 /*
- * Do not allow unaligned operations to proceed.  Return the host address.
+ * Do not allow unaligned operations that cannot be widened to proceed.
+ * Return the host address.
  */
 static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
                                int size, uintptr_t retaddr)
@@ -1244,8 +1245,8 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
         cpu_loop_exit_sigbus(cpu, addr, MMU_DATA_STORE, retaddr);
     }
 
-    /* Enforce qemu required alignment.  */
-    if (unlikely(addr & (size - 1))) {
+    /* Enforce qemu required alignment, unless the access can be widened. */
+    if (unlikely(addr & (size - 1)) && !atomic_widened_ok(addr, size)) {
         cpu_loop_exit_atomic(cpu, retaddr);
     }
 
@@ -3043,6 +3043,82 @@ floatx80 floatx80_round_to_int(floatx80 a, float_status *status)
  * Floating-point to signed integer conversions
  */
 
+/*
+ * Hardfloat float-to-int conversion.  For a zero or normal input whose
+ * rounded value fits the destination, inexact is the only exception
+ * that can be raised, and it is computed exactly by comparing the
+ * rounded value with the input.  This does not depend on the sticky
+ * inexact flag, so unlike can_use_fpu() any rounding mode with a host
+ * equivalent can be handled.  All other cases fall back to softfloat.
+ */
+static inline bool hard_float_to_sint(double a, FloatRoundMode rmode,
+                                      int bits, int64_t *ret, float_status *s)
+{
+    double lim = bits == 32 ? 0x1p31 : 0x1p63;
+    double r;
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        /* The host rounding mode is never changed from nearest-even. */
+        r = rint(a);
+        break;
+    case float_round_to_zero:
+        r = trunc(a);
+        break;
+    case float_round_down:
+        r = floor(a);
+        break;
+    case float_round_up:
+        r = ceil(a);
+        break;
+    case float_round_ties_away:
+        r = round(a);
+        break;
+    default:
+        return false;
+    }
+    if (unlikely(!(r >= -lim && r < lim))) {
+        return false;
+    }
+    if (r != a) {
+        float_raise(float_flag_inexact, s);
+    }
+    *ret = r;
+    return true;
+}
+
+static inline bool float32_to_sint_hard(float32 a, FloatRoundMode rmode,
+                                        int scale, int bits, int64_t *ret,
+                                        float_status *s)
+{
+    union_float32 ua;
+
+    if (QEMU_NO_HARDFLOAT || unlikely(scale != 0)) {
+        return false;
+    }
+    ua.s = a;
+    if (unlikely(!float32_is_zero_or_normal(ua.s))) {
+        return false;
+    }
+    return hard_float_to_sint(ua.h, rmode, bits, ret, s);
+}
+
+static inline bool float64_to_sint_hard(float64 a, FloatRoundMode rmode,
+                                        int scale, int bits, int64_t *ret,
+                                        float_status *s)
+{
+    union_float64 ua;
+
+    if (QEMU_NO_HARDFLOAT || unlikely(scale != 0)) {
+        return false;
+    }
+    ua.s = a;
+    if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        return false;
+    }
+    return hard_float_to_sint(ua.h, rmode, bits, ret, s);
+}
+
 int8_t float16_to_int8_scalbn(float16 a, FloatRoundMode rmode, int scale,
                               float_status *s)
 {
@@ -3092,6 +3168,11 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float32_to_sint_hard(a, rmode, scale, 32, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3101,6 +3182,11 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float32_to_sint_hard(a, rmode, scale, 64, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3119,6 +3205,11 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float64_to_sint_hard(a, rmode, scale, 32, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3128,6 +3219,11 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float64_to_sint_hard(a, rmode, scale, 64, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -172,16 +172,6 @@ static void virtio_blk_discard_write_zeroes_complete(void *opaque, int ret)
     virtio_blk_free_request(req);
 }
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
-{
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
-
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
-    }
-    return req;
-}
-
 static void virtio_blk_handle_scsi(VirtIOBlockReq *req)
 {
     int status;
@@ -972,11 +962,15 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     return 0;
 }
 
+/* Requests popped from the virtqueue at once */
+#define VIRTIO_BLK_POP_BATCH 32
+
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
+    unsigned int i, n;
 
     defer_call_begin();
 
@@ -985,10 +979,20 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+        while ((n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq),
+                                        (void **)reqs, ARRAY_SIZE(reqs)))) {
+            for (i = 0; i < n; i++) {
+                virtio_blk_init_request(s, vq, reqs[i]);
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < n) {
+                /* The device is broken now, drop what is left of the batch */
+                for (; i < n; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
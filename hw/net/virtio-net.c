@@ -23,6 +23,7 @@
 #include "net/tap.h"
 #include "qemu/error-report.h"
 #include "qemu/timer.h"
+#include "qemu/xxhash.h"
 #include "qemu/option.h"
 #include "qemu/option_int.h"
 #include "qemu/config-file.h"
@@ -46,6 +47,7 @@
 #include "monitor/monitor.h"
 #include "hw/pci/pci_device.h"
 #include "net_rx_pkt.h"
+#include "net_tx_pkt.h"
 #include "hw/virtio/vhost.h"
 #include "sysemu/qtest.h"
 
@@ -763,14 +765,20 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
     virtio_add_feature(&features, VIRTIO_NET_F_MAC);
 
     if (!peer_has_vnet_hdr(n)) {
-        virtio_clear_feature(&features, VIRTIO_NET_F_CSUM);
-        virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO4);
-        virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO6);
+        /* With sw-tx-offload, virtio_net_tx_sw_offload() does the work */
+        if (!n->sw_tx_offload) {
+            virtio_clear_feature(&features, VIRTIO_NET_F_CSUM);
+            virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO4);
+            virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO6);
+        }
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_ECN);
 
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_CSUM);
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO4);
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO6);
+        /* With sw-rx-offload, virtio_net_gro_receive() builds them */
+        if (!n->sw_rx_offload) {
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_CSUM);
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO4);
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO6);
+        }
         virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_ECN);
 
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_USO);
@@ -851,6 +859,17 @@ static void virtio_net_apply_guest_offloads(VirtIONet *n)
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_USO6)));
 }
 
+/* Software GRO stands in for the peer, so it follows the guest's toggles */
+static void virtio_net_update_gro(VirtIONet *n)
+{
+    bool csum = n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_CSUM);
+
+    n->gro4_enabled = n->gro_flows && !n->has_vnet_hdr && csum &&
+        (n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO4));
+    n->gro6_enabled = n->gro_flows && !n->has_vnet_hdr && csum &&
+        (n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO6));
+}
+
 static uint64_t virtio_net_guest_offloads_by_features(uint64_t features)
 {
     static const uint64_t guest_offloads_mask =
@@ -980,7 +999,11 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
         n->curr_guest_offloads =
             virtio_net_guest_offloads_by_features(features);
         virtio_net_apply_guest_offloads(n);
+    } else if (n->sw_rx_offload) {
+        n->curr_guest_offloads =
+            virtio_net_guest_offloads_by_features(features);
     }
+    virtio_net_update_gro(n);
 
     for (i = 0;  i < n->max_queue_pairs; i++) {
         NetClientState *nc = qemu_get_subqueue(n->nic, i);
@@ -1069,7 +1092,8 @@ static int virtio_net_handle_offloads(VirtIONet *n, uint8_t cmd,
 
         offloads = virtio_ldq_p(vdev, &offloads);
 
-        if (!n->has_vnet_hdr) {
+        /* sw-rx-offload emulates the offloads the peer can't provide */
+        if (!n->has_vnet_hdr && !n->sw_rx_offload) {
             return VIRTIO_NET_ERR;
         }
 
@@ -1085,7 +1109,10 @@ static int virtio_net_handle_offloads(VirtIONet *n, uint8_t cmd,
         }
 
         n->curr_guest_offloads = offloads;
-        virtio_net_apply_guest_offloads(n);
+        if (n->has_vnet_hdr) {
+            virtio_net_apply_guest_offloads(n);
+        }
+        virtio_net_update_gro(n);
 
         return VIRTIO_NET_OK;
     } else {
@@ -1615,10 +1642,25 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 
 /* RX */
 
+static void virtio_net_gro_flush(VirtIONet *n);
+
 static void virtio_net_handle_rx(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     int queue_index = vq2q(virtio_get_queue_index(vq));
+    int i;
+
+    if (n->gro_stalled) {
+        virtio_net_gro_flush(n);
+        if (n->gro_stalled) {
+            return;
+        }
+        /* Any queue may have been pushed back while GRO was stalled */
+        for (i = 0; i < n->curr_queue_pairs; i++) {
+            qemu_flush_queued_packets(qemu_get_subqueue(n->nic, i));
+        }
+        return;
+    }
 
     qemu_flush_queued_packets(qemu_get_subqueue(n->nic, queue_index));
 }
@@ -1720,6 +1762,8 @@ static void receive_header(VirtIONet *n, const struct iovec *iov, int iov_cnt,
             virtio_net_hdr_swap(VIRTIO_DEVICE(n), wbuf);
         }
         iov_from_buf(iov, iov_cnt, 0, buf, sizeof(struct virtio_net_hdr));
+    } else if (n->gro_hdr) {
+        iov_from_buf(iov, iov_cnt, 0, n->gro_hdr, sizeof(*n->gro_hdr));
     } else {
         struct virtio_net_hdr hdr = {
             .flags = 0,
@@ -2023,12 +2067,17 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
 
     for (j = 0; j < i; j++) {
         /* signal other side */
-        virtqueue_fill(q->rx_vq, elems[j], lens[j], j);
+        virtqueue_fill(q->rx_vq, elems[j], lens[j], q->rx_unflushed + j);
         g_free(elems[j]);
     }
 
-    virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    if (n->rx_batch) {
+        /* Published by virtio_net_receive_batch() at the end of the burst */
+        q->rx_unflushed += i;
+    } else {
+        virtqueue_flush(q->rx_vq, i);
+        virtio_notify(vdev, q->rx_vq);
+    }
 
     return size;
 
@@ -2041,6 +2090,37 @@ err:
     return err;
 }
 
+static void virtio_net_receive_batch(NetClientState *nc, bool begin)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int i;
+
+    if (begin) {
+        n->rx_batch++;
+        return;
+    }
+
+    assert(n->rx_batch > 0);
+    if (n->rx_batch == 1 && (n->gro4_enabled || n->gro6_enabled)) {
+        virtio_net_gro_flush(n);
+    }
+    if (--n->rx_batch) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        if (q->rx_unflushed) {
+            virtqueue_flush(q->rx_vq, q->rx_unflushed);
+            virtio_notify(vdev, q->rx_vq);
+            q->rx_unflushed = 0;
+        }
+    }
+}
+
 static ssize_t virtio_net_do_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
@@ -2657,12 +2737,328 @@ static ssize_t virtio_net_rsc_receive(NetClientState *nc,
     return virtio_net_do_receive(nc, buf, size);
 }
 
+/*
+ * Software GRO for peers without a virtio-net header.  TCP segments of
+ * one receive batch are coalesced per flow in a small hash table and
+ * handed to the guest as GSO packets when the batch ends, so that bulk
+ * transfers need far fewer descriptors and interrupts.
+ */
+#define VIRTIO_NET_GRO_FLOWS    32
+#define VIRTIO_NET_GRO_BUF_SIZE (sizeof(struct eth_header) + \
+                                 sizeof(struct ip6_header) + \
+                                 VIRTIO_NET_MAX_TCP_PAYLOAD)
+
+static bool virtio_net_gro_parse(const uint8_t *buf, size_t size,
+                                 uint16_t *proto, VirtioNetGroUnit *unit)
+{
+    const struct eth_header *eth = (const struct eth_header *)buf;
+    size_t l3_size, l4_size;
+    uint32_t sum;
+
+    if (size < sizeof(struct eth_header)) {
+        return false;
+    }
+    l3_size = size - sizeof(struct eth_header);
+    unit->ip = (uint8_t *)buf + sizeof(struct eth_header);
+    *proto = be16_to_cpu(eth->h_proto);
+
+    switch (*proto) {
+    case ETH_P_IP: {
+        struct ip_header *ip = (struct ip_header *)unit->ip;
+
+        /* No options and no fragments */
+        if (l3_size < sizeof(struct ip_header) + sizeof(struct tcp_header) ||
+            ip->ip_ver_len != ((IP_HEADER_VERSION_4 << 4) |
+                               VIRTIO_NET_IP4_HEADER_LENGTH) ||
+            ip->ip_p != IP_PROTO_TCP ||
+            (be16_to_cpu(ip->ip_off) & ~IP_DF) ||
+            net_raw_checksum(unit->ip, sizeof(struct ip_header))) {
+            return false;
+        }
+        l4_size = be16_to_cpu(ip->ip_len);
+        if (l4_size < sizeof(struct ip_header) + sizeof(struct tcp_header) ||
+            l4_size > l3_size) {
+            return false;
+        }
+        l4_size -= sizeof(struct ip_header);
+        unit->ip_hdrlen = sizeof(struct ip_header);
+        unit->addrs = (uint8_t *)&ip->ip_src;
+        unit->addr_size = VIRTIO_NET_IP4_ADDR_SIZE;
+        break;
+    }
+    case ETH_P_IPV6: {
+        struct ip6_header *ip6 = (struct ip6_header *)unit->ip;
+
+        if (l3_size < sizeof(struct ip6_header) + sizeof(struct tcp_header) ||
+            (unit->ip[0] >> 4) != IP_HEADER_VERSION_6 ||
+            ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt != IP_PROTO_TCP) {
+            return false;
+        }
+        l4_size = be16_to_cpu(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen);
+        if (l4_size < sizeof(struct tcp_header) ||
+            l4_size > l3_size - sizeof(struct ip6_header)) {
+            return false;
+        }
+        unit->ip_hdrlen = sizeof(struct ip6_header);
+        unit->addrs = (uint8_t *)&ip6->ip6_src;
+        unit->addr_size = VIRTIO_NET_IP6_ADDR_SIZE;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    unit->tcp = (struct tcp_header *)(unit->ip + unit->ip_hdrlen);
+    unit->tcp_hdrlen = (be16_to_cpu(unit->tcp->th_offset_flags) &
+                        VIRTIO_NET_TCP_HDR_LENGTH) >> 10;
+    if (unit->tcp_hdrlen < sizeof(struct tcp_header) ||
+        unit->tcp_hdrlen > l4_size) {
+        return false;
+    }
+    unit->payload = l4_size - unit->tcp_hdrlen;
+
+    /*
+     * Coalesced packets reach the guest with a partial checksum only,
+     * so every segment has to be verified here.
+     */
+    sum = net_checksum_add(l4_size, (uint8_t *)unit->tcp);
+    sum += net_checksum_add(unit->addr_size, unit->addrs);
+    sum += IP_PROTO_TCP + l4_size;
+    return !net_checksum_finish(sum);
+}
+
+static uint32_t virtio_net_gro_hash(const VirtioNetGroUnit *unit)
+{
+    uint64_t addrs = 0;
+    int i;
+
+    for (i = 0; i < unit->addr_size; i += sizeof(uint64_t)) {
+        addrs ^= ldq_he_p(unit->addrs + i);
+    }
+    return qemu_xxhash4(addrs, ldl_he_p(&unit->tcp->th_sport));
+}
+
+static bool virtio_net_gro_same_flow(VirtioNetGroFlow *flow,
+                                     NetClientState *nc, uint16_t proto,
+                                     const VirtioNetGroUnit *unit)
+{
+    return flow->nc == nc && flow->proto == proto &&
+           !memcmp(flow->unit.addrs, unit->addrs, unit->addr_size) &&
+           flow->unit.tcp->th_sport == unit->tcp->th_sport &&
+           flow->unit.tcp->th_dport == unit->tcp->th_dport;
+}
+
+/*
+ * Hand a flow to the guest.  Its segments have already been reported
+ * as received to the peer, so if the guest has no room for it the flow
+ * is kept and gro_stalled set; receive then pushes back on the peer
+ * until virtio_net_gro_flush() manages to deliver it.
+ */
+static bool virtio_net_gro_flush_flow(VirtIONet *n, VirtioNetGroFlow *flow)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtioNetGroUnit *unit = &flow->unit;
+    struct virtio_net_hdr hdr = {
+        .flags = VIRTIO_NET_HDR_F_NEEDS_CSUM,
+    };
+    uint16_t l4_size = unit->tcp_hdrlen + unit->payload;
+    uint32_t cntr, cso;
+    ssize_t ret;
+
+    if (flow->segs == 1) {
+        ret = virtio_net_do_receive(flow->nc, flow->buf, flow->size);
+        goto out;
+    }
+
+    if (flow->proto == ETH_P_IP) {
+        struct ip_header *ip = (struct ip_header *)unit->ip;
+
+        ip->ip_len = cpu_to_be16(unit->ip_hdrlen + l4_size);
+        ip->ip_sum = 0;
+        ip->ip_sum = cpu_to_be16(net_raw_checksum(unit->ip, unit->ip_hdrlen));
+        cntr = eth_calc_ip4_pseudo_hdr_csum(ip, l4_size, &cso);
+        hdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    } else {
+        struct ip6_header *ip6 = (struct ip6_header *)unit->ip;
+
+        ip6->ip6_ctlun.ip6_un1.ip6_un1_plen = cpu_to_be16(l4_size);
+        cntr = eth_calc_ip6_pseudo_hdr_csum(ip6, l4_size, IP_PROTO_TCP, &cso);
+        hdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
+    }
+    unit->tcp->th_sum = cpu_to_be16(~net_checksum_finish(cntr));
+
+    virtio_stw_p(vdev, &hdr.hdr_len, sizeof(struct eth_header) +
+                 unit->ip_hdrlen + unit->tcp_hdrlen);
+    virtio_stw_p(vdev, &hdr.gso_size, flow->mss);
+    virtio_stw_p(vdev, &hdr.csum_start,
+                 sizeof(struct eth_header) + unit->ip_hdrlen);
+    virtio_stw_p(vdev, &hdr.csum_offset, offsetof(struct tcp_header, th_sum));
+
+    n->gro_hdr = &hdr;
+    ret = virtio_net_do_receive(flow->nc, flow->buf, flow->size);
+    n->gro_hdr = NULL;
+
+out:
+    if (!ret) {
+        n->gro_stalled = true;
+        return false;
+    }
+    /* Errors mean the device went away or broke: drop it like RSC does */
+    flow->nc = NULL;
+    return true;
+}
+
+static void virtio_net_gro_flush(VirtIONet *n)
+{
+    int i;
+
+    n->gro_stalled = false;
+    for (i = 0; i < VIRTIO_NET_GRO_FLOWS; i++) {
+        if (n->gro_flows[i].nc) {
+            virtio_net_gro_flush_flow(n, &n->gro_flows[i]);
+        }
+    }
+}
+
+static void virtio_net_gro_cache(VirtioNetGroFlow *flow, NetClientState *nc,
+                                 uint16_t proto, const VirtioNetGroUnit *unit)
+{
+    const uint8_t *buf = unit->ip - sizeof(struct eth_header);
+
+    if (!flow->buf) {
+        flow->buf = g_malloc(VIRTIO_NET_GRO_BUF_SIZE);
+    }
+    /* Drop any Ethernet padding */
+    flow->size = sizeof(struct eth_header) + unit->ip_hdrlen +
+                 unit->tcp_hdrlen + unit->payload;
+    memcpy(flow->buf, buf, flow->size);
+
+    flow->nc = nc;
+    flow->proto = proto;
+    flow->mss = unit->payload;
+    flow->segs = 1;
+    flow->next_seq = be32_to_cpu(unit->tcp->th_seq) + unit->payload;
+    flow->unit = *unit;
+    flow->unit.ip = flow->buf + sizeof(struct eth_header);
+    flow->unit.addrs = flow->unit.ip + (unit->addrs - unit->ip);
+    flow->unit.tcp = (struct tcp_header *)(flow->unit.ip + unit->ip_hdrlen);
+}
+
+static bool virtio_net_gro_merge(VirtioNetGroFlow *flow,
+                                 const VirtioNetGroUnit *unit)
+{
+    VirtioNetGroUnit *o_unit = &flow->unit;
+    size_t max_payload;
+
+    if (be32_to_cpu(unit->tcp->th_seq) != flow->next_seq ||
+        unit->payload > flow->mss ||
+        unit->tcp_hdrlen != o_unit->tcp_hdrlen ||
+        /* options, e.g. timestamps, must match */
+        memcmp(unit->tcp + 1, o_unit->tcp + 1,
+               unit->tcp_hdrlen - sizeof(struct tcp_header))) {
+        return false;
+    }
+
+    if (flow->proto == ETH_P_IP) {
+        struct ip_header *ip1 = (struct ip_header *)unit->ip;
+        struct ip_header *ip2 = (struct ip_header *)o_unit->ip;
+
+        if (ip1->ip_tos != ip2->ip_tos || ip1->ip_ttl != ip2->ip_ttl) {
+            return false;
+        }
+        max_payload = VIRTIO_NET_MAX_IP4_PAYLOAD;
+    } else {
+        struct ip6_header *ip1 = (struct ip6_header *)unit->ip;
+        struct ip6_header *ip2 = (struct ip6_header *)o_unit->ip;
+
+        if (ip1->ip6_ctlun.ip6_un1.ip6_un1_flow !=
+            ip2->ip6_ctlun.ip6_un1.ip6_un1_flow ||
+            ip1->ip6_ctlun.ip6_un1.ip6_un1_hlim !=
+            ip2->ip6_ctlun.ip6_un1.ip6_un1_hlim) {
+            return false;
+        }
+        max_payload = VIRTIO_NET_MAX_IP6_PAYLOAD;
+    }
+
+    if (o_unit->tcp_hdrlen + o_unit->payload + unit->payload > max_payload) {
+        return false;
+    }
+
+    memcpy(flow->buf + flow->size,
+           (uint8_t *)unit->tcp + unit->tcp_hdrlen, unit->payload);
+    flow->size += unit->payload;
+    o_unit->payload += unit->payload;
+    flow->next_seq += unit->payload;
+    flow->segs++;
+
+    o_unit->tcp->th_ack = unit->tcp->th_ack;
+    o_unit->tcp->th_win = unit->tcp->th_win;
+    o_unit->tcp->th_offset_flags = unit->tcp->th_offset_flags;
+    return true;
+}
+
+static ssize_t virtio_net_gro_receive(NetClientState *nc,
+                                      const uint8_t *buf, size_t size)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtioNetGroFlow *flow;
+    VirtioNetGroUnit unit;
+    uint16_t proto, flags;
+    bool match;
+
+    if (!virtio_net_can_receive(nc) ||
+        !virtio_net_gro_parse(buf, size, &proto, &unit) ||
+        !(proto == ETH_P_IP ? n->gro4_enabled : n->gro6_enabled)) {
+        return virtio_net_do_receive(nc, buf, size);
+    }
+
+    flow = &n->gro_flows[virtio_net_gro_hash(&unit) % VIRTIO_NET_GRO_FLOWS];
+    match = flow->nc && virtio_net_gro_same_flow(flow, nc, proto, &unit);
+    flags = be16_to_cpu(unit.tcp->th_offset_flags) & VIRTIO_NET_TCP_FLAG;
+
+    /* Control segments and pure acks are passed on, in order */
+    if ((flags & ~(TH_ACK | TH_PUSH)) || !unit.payload) {
+        if (match && !virtio_net_gro_flush_flow(n, flow)) {
+            return 0;
+        }
+        return virtio_net_do_receive(nc, buf, size);
+    }
+
+    if (match && virtio_net_gro_merge(flow, &unit)) {
+        /* A short or pushed segment ends the train */
+        if (unit.payload < flow->mss || (flags & TH_PUSH)) {
+            virtio_net_gro_flush_flow(n, flow);
+        }
+        return size;
+    }
+
+    if (flow->nc && !virtio_net_gro_flush_flow(n, flow)) {
+        return 0;
+    }
+    if (flags & TH_PUSH) {
+        return virtio_net_do_receive(nc, buf, size);
+    }
+    virtio_net_gro_cache(flow, nc, proto, &unit);
+    return size;
+}
+
 static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
+
+    /* Held back GRO packets go first, or nothing does */
+    if (unlikely(n->gro_stalled)) {
+        virtio_net_gro_flush(n);
+        if (n->gro_stalled) {
+            return 0;
+        }
+    }
+
     if ((n->rsc4_enabled || n->rsc6_enabled)) {
         return virtio_net_rsc_receive(nc, buf, size);
+    } else if (n->rx_batch && (n->gro4_enabled || n->gro6_enabled)) {
+        return virtio_net_gro_receive(nc, buf, size);
     } else {
         return virtio_net_do_receive(nc, buf, size);
     }
@@ -2702,6 +3098,156 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     }
 }
 
+static void virtio_net_tx_end_burst(VirtIONetQueue *q, NetClientState *nc,
+                                    unsigned int count)
+{
+    qemu_net_batch_end(nc);
+    if (count) {
+        RCU_READ_LOCK_GUARD();
+
+        virtqueue_flush(q->tx_vq, count);
+        virtio_notify(VIRTIO_DEVICE(q->n), q->tx_vq);
+    }
+}
+
+static void virtio_net_tx_pkt_free_frag(void *opaque, void *base, size_t len)
+{
+    /* Fragments point into the element, which the caller owns */
+}
+
+static void virtio_net_tx_sw_offload_sent(NetClientState *nc, ssize_t len)
+{
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
+    assert(q->async_tx.segs);
+    if (--q->async_tx.segs == 0) {
+        virtio_net_tx_complete(nc, len);
+    }
+}
+
+static void virtio_net_tx_sw_offload_send(void *opaque,
+                                          const struct iovec *iov, int iovcnt,
+                                          const struct iovec *virt_iov,
+                                          int virt_iovcnt)
+{
+    NetClientState *nc = opaque;
+
+    if (!qemu_sendv_packet_async(nc, iov, iovcnt,
+                                 virtio_net_tx_sw_offload_sent)) {
+        virtio_net_get_subqueue(nc)->async_tx.segs++;
+    }
+}
+
+/*
+ * Checksum a packet the way the guest asked for it, from csum_start and
+ * csum_offset, for L4 protocols NetTxPkt does not know about.  @vhdr is
+ * a host endian copy of the guest header.
+ */
+static ssize_t virtio_net_tx_sw_csum(VirtIONet *n, NetClientState *nc,
+                                     const struct virtio_net_hdr *vhdr,
+                                     const struct iovec *out_sg,
+                                     unsigned int out_num)
+{
+    size_t size = iov_size(out_sg, out_num);
+    size_t start = vhdr->csum_start;
+    size_t csum_at = start + vhdr->csum_offset;
+    g_autofree uint8_t *buf = NULL;
+    struct iovec iov;
+
+    if (size < n->guest_hdr_len ||
+        csum_at + sizeof(uint16_t) > size - n->guest_hdr_len) {
+        /* Bogus offsets: drop it rather than send it corrupted */
+        return 1;
+    }
+
+    size -= n->guest_hdr_len;
+    buf = g_malloc(size);
+    iov_to_buf(out_sg, out_num, n->guest_hdr_len, buf, size);
+    stw_be_p(buf + csum_at,
+             net_checksum_finish_nozero(net_checksum_add(size - start,
+                                                         buf + start)));
+
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    if (!qemu_sendv_packet_async(nc, &iov, 1,
+                                 virtio_net_tx_sw_offload_sent)) {
+        virtio_net_get_subqueue(nc)->async_tx.segs++;
+        return 0;
+    }
+    return size;
+}
+
+/*
+ * Emulate checksum and TCP segmentation offloads requested by the guest
+ * for a peer that cannot take a virtio-net header.  @out_sg starts with
+ * the guest header, still in guest endianness since needs_vnet_hdr_swap
+ * is only set for peers that take one.  Returns false if the packet should
+ * be sent as is; otherwise @ret is set like qemu_sendv_packet_async()
+ * would, 0 meaning the peer queued (part of) the packet.
+ */
+static bool virtio_net_tx_sw_offload(VirtIONet *n, NetClientState *nc,
+                                     const struct iovec *out_sg,
+                                     unsigned int out_num, ssize_t *ret)
+{
+    struct NetTxPkt *pkt = n->tx_pkt;
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+    struct virtio_net_hdr vhdr;
+    size_t offset = n->guest_hdr_len;
+    bool tso;
+    int i;
+
+    if (iov_to_buf(out_sg, out_num, 0, &vhdr, sizeof(vhdr)) < sizeof(vhdr)) {
+        return false;
+    }
+    virtio_net_hdr_swap(VIRTIO_DEVICE(n), &vhdr);
+
+    tso = (vhdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) != VIRTIO_NET_HDR_GSO_NONE;
+    if (!tso && !(vhdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) {
+        return false;
+    }
+
+    net_tx_pkt_reset(pkt, virtio_net_tx_pkt_free_frag, NULL);
+    for (i = 0; i < out_num; i++) {
+        if (offset >= out_sg[i].iov_len) {
+            offset -= out_sg[i].iov_len;
+            continue;
+        }
+        if (!net_tx_pkt_add_raw_fragment(pkt, out_sg[i].iov_base + offset,
+                                         out_sg[i].iov_len - offset)) {
+            goto fallback;
+        }
+        offset = 0;
+    }
+
+    if (!net_tx_pkt_parse(pkt) ||
+        !net_tx_pkt_build_vheader(pkt, tso, true, vhdr.gso_size)) {
+        goto fallback;
+    }
+    if (!tso &&
+        !(net_tx_pkt_get_vhdr(pkt)->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) {
+        /* Not TCP or UDP, NetTxPkt would leave the checksum alone */
+        goto fallback;
+    }
+    if (tso) {
+        net_tx_pkt_update_ip_checksums(pkt);
+    }
+
+    assert(!q->async_tx.segs);
+    /* Oversized packets are dropped here, as a real backend would */
+    net_tx_pkt_send_custom(pkt, false, virtio_net_tx_sw_offload_send, nc);
+    *ret = q->async_tx.segs ? 0 : net_tx_pkt_get_total_len(pkt);
+    return true;
+
+fallback:
+    if (tso) {
+        /* Cannot segment what cannot be parsed, drop it */
+        *ret = 1;
+    } else {
+        *ret = virtio_net_tx_sw_csum(n, nc, &vhdr, out_sg, out_num);
+    }
+    return true;
+}
+
 /* TX */
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
@@ -2710,6 +3256,8 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
     VirtQueueElement *elem;
     int32_t num_packets = 0;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    NetClientState *nc = qemu_get_subqueue(n->nic, queue_index);
+
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
     }
@@ -2719,6 +3267,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         return num_packets;
     }
 
+    qemu_net_batch_begin(nc);
     for (;;) {
         ssize_t ret;
         unsigned int out_num;
@@ -2754,6 +3303,12 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
             out_num += 1;
             out_sg = sg2;
         }
+
+        if (n->tx_pkt && !peer_has_vnet_hdr(n) &&
+            virtio_net_tx_sw_offload(n, nc, out_sg, out_num, &ret)) {
+            goto sent;
+        }
+
         /*
          * If host wants to see the guest header as is, we can
          * pass it on unchanged. Otherwise, copy just the parts
@@ -2780,26 +3335,35 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
             }
         }
 
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
+        ret = qemu_sendv_packet_async(nc, out_sg, out_num,
+                                      virtio_net_tx_complete);
+sent:
         if (ret == 0) {
+            virtio_net_tx_end_burst(q, nc, num_packets);
             virtio_queue_set_notification(q->tx_vq, 0);
             q->async_tx.elem = elem;
             return -EBUSY;
         }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        /*
+         * Completions are published to the used ring once per burst so
+         * the guest sees a single index update and interrupt.
+         */
+        WITH_RCU_READ_LOCK_GUARD() {
+            virtqueue_fill(q->tx_vq, elem, 0, num_packets);
+        }
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
             break;
         }
     }
+    virtio_net_tx_end_burst(q, nc, num_packets);
     return num_packets;
 
 detach:
+    virtio_net_tx_end_burst(q, nc, num_packets);
     virtqueue_detach_element(q->tx_vq, elem, 0);
     g_free(elem);
     return -EINVAL;
@@ -3128,6 +3692,7 @@ static int virtio_net_post_load_virtio(VirtIODevice *vdev)
     if (peer_has_vnet_hdr(n)) {
         virtio_net_apply_guest_offloads(n);
     }
+    virtio_net_update_gro(n);
 
     return 0;
 }
@@ -3377,6 +3942,7 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_batch = virtio_net_receive_batch,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
@@ -3778,6 +4344,12 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     n->qdev = dev;
 
     net_rx_pkt_init(&n->rx_pkt);
+    if (n->sw_tx_offload) {
+        net_tx_pkt_init(&n->tx_pkt, VIRTQUEUE_MAX_SIZE);
+    }
+    if (n->sw_rx_offload) {
+        n->gro_flows = g_new0(VirtioNetGroFlow, VIRTIO_NET_GRO_FLOWS);
+    }
 
     if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSS)) {
         Error *err = NULL;
@@ -3841,6 +4413,13 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
     net_rx_pkt_uninit(n->rx_pkt);
+    net_tx_pkt_uninit(n->tx_pkt);
+    if (n->gro_flows) {
+        for (i = 0; i < VIRTIO_NET_GRO_FLOWS; i++) {
+            g_free(n->gro_flows[i].buf);
+        }
+        g_free(n->gro_flows);
+    }
     virtio_cleanup(vdev);
 }
 
@@ -3877,6 +4456,14 @@ static void virtio_net_reset(VirtIODevice *vdev)
         flush_or_purge_queued_packets(qemu_get_subqueue(n->nic, i));
     }
 
+    /* Drop packets software GRO held back for the old rings */
+    if (n->gro_flows) {
+        for (i = 0; i < VIRTIO_NET_GRO_FLOWS; i++) {
+            n->gro_flows[i].nc = NULL;
+        }
+    }
+    n->gro_stalled = false;
+
     virtio_net_disable_rss(n);
 }
 
@@ -4027,6 +4614,8 @@ static Property virtio_net_properties[] = {
     DEFINE_PROP_UINT16("host_mtu", VirtIONet, net_conf.mtu, 0),
     DEFINE_PROP_BOOL("x-mtu-bypass-backend", VirtIONet, mtu_bypass_backend,
                      true),
+    DEFINE_PROP_BOOL("sw-tx-offload", VirtIONet, sw_tx_offload, false),
+    DEFINE_PROP_BOOL("sw-rx-offload", VirtIONet, sw_rx_offload, false),
     DEFINE_PROP_INT32("speed", VirtIONet, net_conf.speed, SPEED_UNKNOWN),
     DEFINE_PROP_STRING("duplex", VirtIONet, net_conf.duplex_str),
     DEFINE_PROP_BOOL("failover", VirtIONet, failover, false),
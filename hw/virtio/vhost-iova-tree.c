@@ -70,6 +70,16 @@ const DMAMap *vhost_iova_tree_find_iova(const VhostIOVATree *tree,
     return iova_tree_find_iova(tree->iova_taddr_map, map);
 }
 
+/**
+ * Get the generation of the tree, that changes on every map or unmap
+ *
+ * @tree: The iova tree
+ */
+uint64_t vhost_iova_tree_generation(const VhostIOVATree *tree)
+{
+    return iova_tree_generation(tree->iova_taddr_map);
+}
+
 /**
  * Allocate a new mapping
  *
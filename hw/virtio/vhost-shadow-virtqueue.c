@@ -79,32 +79,44 @@ uint16_t vhost_svq_available_slots(const VhostShadowVirtqueue *svq)
  * @iovec: Source qemu's VA addresses
  * @num: Length of iovec and minimum length of vaddr
  */
-static bool vhost_svq_translate_addr(const VhostShadowVirtqueue *svq,
+static bool vhost_svq_translate_addr(VhostShadowVirtqueue *svq,
                                      hwaddr *addrs, const struct iovec *iovec,
                                      size_t num)
 {
+    uint64_t gen;
+
     if (num == 0) {
         return true;
     }
 
+    gen = vhost_iova_tree_generation(svq->iova_tree);
     for (size_t i = 0; i < num; ++i) {
         DMAMap needle = {
             .translated_addr = (hwaddr)(uintptr_t)iovec[i].iov_base,
             .size = iovec[i].iov_len,
         };
         Int128 needle_last, map_last;
+        const DMAMap *map = &svq->iova_cache;
         size_t off;
 
-        const DMAMap *map = vhost_iova_tree_find_iova(svq->iova_tree, &needle);
-        /*
-         * Map cannot be NULL since iova map contains all guest space and
-         * qemu already has a physical address mapped
-         */
-        if (unlikely(!map)) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "Invalid address 0x%"HWADDR_PRIx" given by guest",
-                          needle.translated_addr);
-            return false;
+        /* Guest buffers tend to be close to each other, try the last map */
+        if (svq->iova_cache_gen != gen ||
+            needle.translated_addr < map->translated_addr ||
+            needle.translated_addr - map->translated_addr > map->size) {
+            map = vhost_iova_tree_find_iova(svq->iova_tree, &needle);
+            /*
+             * Map cannot be NULL since iova map contains all guest space and
+             * qemu already has a physical address mapped
+             */
+            if (unlikely(!map)) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "Invalid address 0x%"HWADDR_PRIx" given by guest",
+                              needle.translated_addr);
+                return false;
+            }
+
+            svq->iova_cache = *map;
+            svq->iova_cache_gen = gen;
         }
 
         off = needle.translated_addr - map->translated_addr;
@@ -204,23 +216,35 @@ static bool vhost_svq_add_split(VhostShadowVirtqueue *svq,
 
     /*
      * Put the entry in the available array (but don't update avail->idx until
-     * they do sync).
+     * vhost_svq_kick(), so a batch of entries is exposed at once).
      */
     avail_idx = svq->shadow_avail_idx & (svq->vring.num - 1);
     avail->ring[avail_idx] = cpu_to_le16(*head);
     svq->shadow_avail_idx++;
 
-    /* Update the avail index after write the descriptor */
-    smp_wmb();
-    avail->idx = cpu_to_le16(svq->shadow_avail_idx);
-
     return true;
 }
 
+/**
+ * Expose the entries added since the last call to the device, and notify
+ * it unless it suppressed notifications for them.
+ *
+ * @svq: The svq
+ */
 static void vhost_svq_kick(VhostShadowVirtqueue *svq)
 {
+    /* Only SVQ writes avail->idx, so it holds the last exposed index */
+    uint16_t old_avail_idx = le16_to_cpu(svq->vring.avail->idx);
     bool needs_kick;
 
+    if (old_avail_idx == svq->shadow_avail_idx) {
+        return;
+    }
+
+    /* Update the avail index after write the descriptors */
+    smp_wmb();
+    svq->vring.avail->idx = cpu_to_le16(svq->shadow_avail_idx);
+
     /*
      * We need to expose the available array entries before checking the used
      * flags
@@ -228,8 +252,10 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     smp_mb();
 
     if (virtio_vdev_has_feature(svq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        uint16_t avail_event = *(uint16_t *)(&svq->vring.used->ring[svq->vring.num]);
-        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, svq->shadow_avail_idx - 1);
+        uint16_t avail_event = le16_to_cpu(
+                *(uint16_t *)(&svq->vring.used->ring[svq->vring.num]));
+        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx,
+                                      old_avail_idx);
     } else {
         needs_kick = !(svq->vring.used->flags & VRING_USED_F_NO_NOTIFY);
     }
@@ -241,14 +267,15 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     event_notifier_set(&svq->hdev_kick);
 }
 
-/**
- * Add an element to a SVQ.
+/*
+ * Add an element to a SVQ without exposing it to the device yet.
  *
  * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
  */
-int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
-                  size_t out_num, const struct iovec *in_sg, size_t in_num,
-                  VirtQueueElement *elem)
+static int vhost_svq_add_nokick(VhostShadowVirtqueue *svq,
+                                const struct iovec *out_sg, size_t out_num,
+                                const struct iovec *in_sg, size_t in_num,
+                                VirtQueueElement *elem)
 {
     unsigned qemu_head;
     unsigned ndescs = in_num + out_num;
@@ -266,16 +293,35 @@ int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
     svq->num_free -= ndescs;
     svq->desc_state[qemu_head].elem = elem;
     svq->desc_state[qemu_head].ndescs = ndescs;
-    vhost_svq_kick(svq);
     return 0;
 }
 
-/* Convenience wrapper to add a guest's element to SVQ */
+/**
+ * Add an element to a SVQ.
+ *
+ * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+ */
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const struct iovec *in_sg, size_t in_num,
+                  VirtQueueElement *elem)
+{
+    int r = vhost_svq_add_nokick(svq, out_sg, out_num, in_sg, in_num, elem);
+
+    if (likely(r == 0)) {
+        vhost_svq_kick(svq);
+    }
+    return r;
+}
+
+/*
+ * Convenience wrapper to add a guest's element to SVQ.  The caller kicks
+ * the device once for the whole batch.
+ */
 static int vhost_svq_add_element(VhostShadowVirtqueue *svq,
                                  VirtQueueElement *elem)
 {
-    return vhost_svq_add(svq, elem->out_sg, elem->out_num, elem->in_sg,
-                         elem->in_num, elem);
+    return vhost_svq_add_nokick(svq, elem->out_sg, elem->out_num, elem->in_sg,
+                                elem->in_num, elem);
 }
 
 /**
@@ -336,12 +382,14 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
                 }
 
                 /* VQ is full or broken, just return and ignore kicks */
+                vhost_svq_kick(svq);
                 return;
             }
             /* elem belongs to SVQ or external caller now */
             elem = NULL;
         }
 
+        vhost_svq_kick(svq);
         virtio_queue_set_notification(svq->vq, true);
     } while (!virtio_queue_empty(svq->vq));
 }
@@ -502,7 +550,17 @@ static void vhost_svq_flush(VhostShadowVirtqueue *svq,
         }
 
         virtqueue_flush(vq, i);
-        event_notifier_set(&svq->svq_call);
+        if (i) {
+            bool notify;
+
+            /* Honour the guest's used event / interrupt suppression */
+            WITH_RCU_READ_LOCK_GUARD() {
+                notify = virtio_should_notify(svq->vdev, vq);
+            }
+            if (notify) {
+                event_notifier_set(&svq->svq_call);
+            }
+        }
 
         if (check_for_avail_queue && svq->next_guest_avail_elem) {
             /*
@@ -669,6 +727,7 @@ void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
     svq->vdev = vdev;
     svq->vq = vq;
     svq->iova_tree = iova_tree;
+    svq->iova_cache_gen = vhost_iova_tree_generation(iova_tree) - 1;
 
     svq->vring.num = virtio_queue_get_num(vdev, virtio_get_queue_index(vq));
     svq->num_free = svq->vring.num;
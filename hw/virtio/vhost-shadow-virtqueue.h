@@ -78,6 +78,10 @@ typedef struct VhostShadowVirtqueue {
     /* IOVA mapping */
     VhostIOVATree *iova_tree;
 
+    /* Last mapping used for a translation, and the iova_tree generation */
+    DMAMap iova_cache;
+    uint64_t iova_cache_gen;
+
     /* SVQ vring descriptors state */
     SVQDescState *desc_state;
 
@@ -18,6 +18,7 @@
 #include "qapi/qmp/qobject.h"
 #include "qapi/qmp/qjson.h"
 #include "hw/virtio/vhost-user.h"
+#include "sysemu/stats.h"
 
 #include "standard-headers/linux/virtio_ids.h"
 #include "standard-headers/linux/vhost_types.h"
@@ -710,6 +711,96 @@ VirtioInfoList *qmp_x_query_virtio(Error **errp)
     return vdevs;
 }
 
+typedef struct VirtioStatsArgs {
+    StatsResultList **result;
+    strList *names;
+} VirtioStatsArgs;
+
+static const char *const virtio_stats_names[] = {
+    "completions", "interrupts",
+};
+
+static void virtio_stats_add(StatsList **list, const char *name,
+                             uint64_t value, strList *names)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = value;
+    QAPI_LIST_PREPEND(*list, stats);
+}
+
+static int virtio_stats_query_child(Object *child, void *opaque)
+{
+    VirtioStatsArgs *args = opaque;
+    Object *dev = object_dynamic_cast(child, TYPE_VIRTIO_DEVICE);
+    StatsList *stats_list = NULL;
+    g_autofree char *path = NULL;
+    VirtIODevice *vdev;
+
+    if (dev == NULL || !DEVICE(dev)->realized) {
+        return 0;
+    }
+
+    vdev = VIRTIO_DEVICE(dev);
+    virtio_stats_add(&stats_list, "completions",
+                     stat64_get(&vdev->completions), args->names);
+    virtio_stats_add(&stats_list, "interrupts",
+                     stat64_get(&vdev->interrupts), args->names);
+    if (stats_list) {
+        path = object_get_canonical_path(dev);
+        add_stats_entry(args->result, STATS_PROVIDER_VIRTIO, path,
+                        stats_list);
+    }
+    return 0;
+}
+
+static void virtio_stats_cb(StatsResultList **result, StatsTarget target,
+                            strList *names, strList *targets, Error **errp)
+{
+    VirtioStatsArgs args = {
+        .result = result,
+        .names = names,
+    };
+
+    if (target != STATS_TARGET_VIRTIO) {
+        return;
+    }
+
+    object_child_foreach_recursive(object_get_root(),
+                                   virtio_stats_query_child, &args);
+}
+
+static void virtio_stats_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+
+    for (int i = 0; i < ARRAY_SIZE(virtio_stats_names); i++) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(virtio_stats_names[i]);
+        value->type = STATS_TYPE_CUMULATIVE;
+        QAPI_LIST_PREPEND(stats_list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_VIRTIO, STATS_TARGET_VIRTIO,
+                     stats_list);
+}
+
+/* Expose the per-device interrupt counters through query-stats */
+void virtio_stats_register(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_VIRTIO, virtio_stats_cb,
+                        virtio_stats_schemas_cb);
+}
+
 VirtIODevice *qmp_find_virtio_device(const char *path)
 {
     /* Verify the canonical path is a realized virtio device */
@@ -14,6 +14,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-virtio.h"
+#include "qapi/visitor.h"
 #include "trace.h"
 #include "qemu/defer-call.h"
 #include "qemu/error-report.h"
@@ -32,6 +33,7 @@
 #include "hw/virtio/virtio-access.h"
 #include "sysemu/dma.h"
 #include "sysemu/runstate.h"
+#include "sysemu/xen.h"
 #include "virtio-qmp.h"
 
 #include "standard-headers/linux/virtio_ids.h"
@@ -153,6 +155,20 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /*
+     * Interrupt coalescing, see VirtIODevice::coalesce_usecs.  The timer
+     * always runs in the main loop, while notifications may come from an
+     * IOThread, so everything it looks at is accessed atomically.
+     */
+    QEMUTimer *coalesce_timer;
+    /* Used ring completions so far, and as of the last interrupt */
+    uint32_t coalesce_used;
+    uint32_t coalesce_signalled;
+    bool coalesce_pending;
+    bool coalesce_irqfd;
+    /* Only accessed by the thread that processes the queue */
+    int64_t coalesce_last_ns;
 };
 
 const char *virtio_device_names[] = {
@@ -1151,6 +1167,9 @@ void virtqueue_flush(VirtQueue *vq, unsigned int count)
         return;
     }
 
+    qatomic_set(&vq->coalesce_used, vq->coalesce_used + count);
+    stat64_add(&vq->vdev->completions, count);
+
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER)) {
         virtqueue_ordered_flush(vq);
     } else if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
@@ -1552,7 +1571,75 @@ int virtqueue_avail_bytes(VirtQueue *vq, unsigned int in_bytes,
     return in_bytes <= in_total && out_bytes <= out_total;
 }
 
-static bool virtqueue_map_desc(VirtIODevice *vdev, unsigned int *p_num_sg,
+/*
+ * The directly accessible guest range that the last descriptor mapped fell
+ * in.  Descriptors of a chain, and of consecutive chains, are usually backed
+ * by the same RAM section, so this spares a flatview (and IOMMU) translation
+ * per scatter-gather entry.  Only valid within the RCU critical section that
+ * filled it.
+ */
+typedef struct VirtQueueMapCache {
+    MemoryRegion *mr;
+    hwaddr pa;
+    hwaddr len;
+    void *host;
+    bool is_write;
+} VirtQueueMapCache;
+
+/* Called within rcu_read_lock().  */
+static bool virtqueue_map_cache_fill(VirtIODevice *vdev,
+                                     VirtQueueMapCache *cache,
+                                     hwaddr pa, bool is_write)
+{
+    hwaddr xlat, len = HWADDR_MAX - pa;
+    MemoryRegion *mr;
+
+    cache->mr = NULL;
+    if (xen_enabled()) {
+        /* Xen maps guest memory through its map cache */
+        return false;
+    }
+
+    mr = address_space_translate(vdev->dma_as, pa, &xlat, &len, is_write,
+                                 MEMTXATTRS_UNSPECIFIED);
+    if (!memory_access_is_direct(mr, is_write) || !mr->ram_block || !len) {
+        return false;
+    }
+
+    cache->mr = mr;
+    cache->pa = pa;
+    cache->len = len;
+    cache->host = qemu_map_ram_ptr(mr->ram_block, xlat);
+    cache->is_write = is_write;
+    return true;
+}
+
+/* Called within rcu_read_lock().  */
+static void *virtqueue_map_cached(VirtIODevice *vdev, VirtQueueMapCache *cache,
+                                  hwaddr pa, hwaddr *plen, bool is_write)
+{
+    hwaddr off;
+
+    if (!cache->mr || cache->is_write != is_write || pa < cache->pa ||
+        pa - cache->pa >= cache->len) {
+        if (!virtqueue_map_cache_fill(vdev, cache, pa, is_write)) {
+            return dma_memory_map(vdev->dma_as, pa, plen,
+                                  is_write ? DMA_DIRECTION_FROM_DEVICE :
+                                             DMA_DIRECTION_TO_DEVICE,
+                                  MEMTXATTRS_UNSPECIFIED);
+        }
+    }
+
+    /* Same reference address_space_map() takes, dropped on unmap */
+    memory_region_ref(cache->mr);
+    off = pa - cache->pa;
+    *plen = MIN(*plen, cache->len - off);
+    fuzz_dma_read_cb(pa, *plen, cache->mr);
+    return cache->host + off;
+}
+
+static bool virtqueue_map_desc(VirtIODevice *vdev, VirtQueueMapCache *cache,
+                               unsigned int *p_num_sg,
                                hwaddr *addr, struct iovec *iov,
                                unsigned int max_num_sg, bool is_write,
                                hwaddr pa, size_t sz)
@@ -1575,11 +1662,8 @@ static bool virtqueue_map_desc(VirtIODevice *vdev, unsigned int *p_num_sg,
             goto out;
         }
 
-        iov[num_sg].iov_base = dma_memory_map(vdev->dma_as, pa, &len,
-                                              is_write ?
-                                              DMA_DIRECTION_FROM_DEVICE :
-                                              DMA_DIRECTION_TO_DEVICE,
-                                              MEMTXATTRS_UNSPECIFIED);
+        iov[num_sg].iov_base = virtqueue_map_cached(vdev, cache, pa, &len,
+                                                    is_write);
         if (!iov[num_sg].iov_base) {
             virtio_error(vdev, "virtio: bogus descriptor or out of resources");
             goto out;
@@ -1670,7 +1754,8 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz,
+                                 VirtQueueMapCache *map_cache)
 {
     unsigned int i, head, max, idx;
     VRingMemoryRegionCaches *caches;
@@ -1753,8 +1838,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         bool map_ok;
 
         if (desc.flags & VRING_DESC_F_WRITE) {
-            map_ok = virtqueue_map_desc(vdev, &in_num, addr + out_num,
-                                        iov + out_num,
+            map_ok = virtqueue_map_desc(vdev, map_cache, &in_num,
+                                        addr + out_num, iov + out_num,
                                         VIRTQUEUE_MAX_SIZE - out_num, true,
                                         desc.addr, desc.len);
         } else {
@@ -1762,7 +1847,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
                 virtio_error(vdev, "Incorrect order for descriptors");
                 goto err_undo_map;
             }
-            map_ok = virtqueue_map_desc(vdev, &out_num, addr, iov,
+            map_ok = virtqueue_map_desc(vdev, map_cache, &out_num, addr, iov,
                                         VIRTQUEUE_MAX_SIZE, false,
                                         desc.addr, desc.len);
         }
@@ -1816,7 +1901,8 @@ err_undo_map:
     goto done;
 }
 
-static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
+static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz,
+                                  VirtQueueMapCache *map_cache)
 {
     unsigned int i, max;
     VRingMemoryRegionCaches *caches;
@@ -1890,8 +1976,8 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
         bool map_ok;
 
         if (desc.flags & VRING_DESC_F_WRITE) {
-            map_ok = virtqueue_map_desc(vdev, &in_num, addr + out_num,
-                                        iov + out_num,
+            map_ok = virtqueue_map_desc(vdev, map_cache, &in_num,
+                                        addr + out_num, iov + out_num,
                                         VIRTQUEUE_MAX_SIZE - out_num, true,
                                         desc.addr, desc.len);
         } else {
@@ -1899,7 +1985,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
                 virtio_error(vdev, "Incorrect order for descriptors");
                 goto err_undo_map;
             }
-            map_ok = virtqueue_map_desc(vdev, &out_num, addr, iov,
+            map_ok = virtqueue_map_desc(vdev, map_cache, &out_num, addr, iov,
                                         VIRTQUEUE_MAX_SIZE, false,
                                         desc.addr, desc.len);
         }
@@ -1967,17 +2053,51 @@ err_undo_map:
 
 void *virtqueue_pop(VirtQueue *vq, size_t sz)
 {
+    VirtQueueMapCache map_cache = {};
+
     if (virtio_device_disabled(vq->vdev)) {
         return NULL;
     }
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        return virtqueue_packed_pop(vq, sz);
+        return virtqueue_packed_pop(vq, sz, &map_cache);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        return virtqueue_split_pop(vq, sz, &map_cache);
     }
 }
 
+/*
+ * Pop up to @max elements into @elems, each as virtqueue_pop() would return
+ * it.  Returns the number of elements popped.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    VirtQueueMapCache map_cache = {};
+    bool packed;
+    unsigned int n = 0;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    packed = virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED);
+
+    /* One critical section, so the mapping cache stays valid for the batch */
+    RCU_READ_LOCK_GUARD();
+    while (n < max) {
+        void *elem = packed ? virtqueue_packed_pop(vq, sz, &map_cache) :
+                              virtqueue_split_pop(vq, sz, &map_cache);
+
+        if (!elem) {
+            break;
+        }
+        elems[n++] = elem;
+    }
+
+    return n;
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -2282,6 +2402,12 @@ static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
     vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
     vdev->vq[i].inuse = 0;
     virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
+    if (vdev->vq[i].coalesce_timer) {
+        timer_del(vdev->vq[i].coalesce_timer);
+    }
+    qatomic_set(&vdev->vq[i].coalesce_pending, false);
+    qatomic_set(&vdev->vq[i].coalesce_signalled, vdev->vq[i].coalesce_used);
+    vdev->vq[i].coalesce_last_ns = 0;
 }
 
 void virtio_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
@@ -2562,6 +2688,8 @@ void virtio_delete_queue(VirtQueue *vq)
     g_free(vq->used_elems);
     vq->used_elems = NULL;
     virtio_virtqueue_reset_region_cache(vq);
+    g_clear_pointer(&vq->coalesce_timer, timer_free);
+    qatomic_set(&vq->coalesce_pending, false);
 }
 
 void virtio_del_queue(VirtIODevice *vdev, int n)
@@ -2653,7 +2781,7 @@ static bool virtio_packed_should_notify(VirtIODevice *vdev, VirtQueue *vq)
 }
 
 /* Called within rcu_read_lock().  */
-static bool virtio_should_notify(VirtIODevice *vdev, VirtQueue *vq)
+bool virtio_should_notify(VirtIODevice *vdev, VirtQueue *vq)
 {
     if (virtio_vdev_has_feature(vdev, VIRTIO_F_RING_PACKED)) {
         return virtio_packed_should_notify(vdev, vq);
@@ -2672,16 +2800,8 @@ static void virtio_notify_irqfd_deferred_fn(void *opaque)
     event_notifier_set(notifier);
 }
 
-void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_irqfd(VirtQueue *vq)
 {
-    WITH_RCU_READ_LOCK_GUARD() {
-        if (!virtio_should_notify(vdev, vq)) {
-            return;
-        }
-    }
-
-    trace_virtio_notify_irqfd(vdev, vq);
-
     /*
      * virtio spec 1.0 says ISR bit 0 should be ignored with MSI, but
      * windows drivers included in virtio-win 1.8.0 (circa 2015) are
@@ -2707,16 +2827,127 @@ static void virtio_irq(VirtQueue *vq)
     virtio_notify_vector(vq->vdev, vq->vector);
 }
 
+static void virtio_coalesce_deliver(VirtQueue *vq, bool irqfd)
+{
+    qatomic_set(&vq->coalesce_signalled, qatomic_read(&vq->coalesce_used));
+    stat64_inc(&vq->vdev->interrupts);
+    if (irqfd) {
+        virtio_irqfd(vq);
+    } else {
+        virtio_irq(vq);
+    }
+}
+
+static void virtio_coalesce_timer_cb(void *opaque)
+{
+    VirtQueue *vq = opaque;
+
+    if (qatomic_xchg(&vq->coalesce_pending, false)) {
+        virtio_coalesce_deliver(vq, qatomic_read(&vq->coalesce_irqfd));
+    }
+}
+
+/* Deliver a notification held back by coalescing right away */
+static void virtio_coalesce_flush(VirtQueue *vq)
+{
+    if (vq->coalesce_timer) {
+        timer_del(vq->coalesce_timer);
+    }
+    virtio_coalesce_timer_cb(vq);
+}
+
+/*
+ * Deliver a notification the guest asked for, or hold it back so that it
+ * is folded into a later one, like NIC interrupt moderation.
+ *
+ * The irqfd path may run in an IOThread, but the timer stays in the main
+ * loop: it only touches atomics and sends the interrupt, which is safe
+ * from any thread for irqfd and happens under the BQL for virtio_irq().
+ * Racing with the timer at worst sends one extra interrupt.
+ */
+static void virtio_coalesce_notify(VirtIODevice *vdev, VirtQueue *vq,
+                                   bool irqfd)
+{
+    uint32_t usecs = qatomic_read(&vdev->coalesce_usecs);
+    uint32_t max_frames = qatomic_read(&vdev->coalesce_max_frames);
+    uint32_t frames = vq->coalesce_used - qatomic_read(&vq->coalesce_signalled);
+    int64_t now;
+
+    if (qatomic_read(&vq->coalesce_pending)) {
+        if (usecs && qatomic_read(&vq->coalesce_irqfd) == irqfd &&
+            (!max_frames || frames < max_frames)) {
+            /* The timer will deliver it */
+            return;
+        }
+        /* Over max-frames, disabled or switched paths: deliver it now */
+        if (qatomic_xchg(&vq->coalesce_pending, false)) {
+            timer_del(vq->coalesce_timer);
+        }
+        virtio_coalesce_deliver(vq, irqfd);
+        return;
+    }
+
+    if (!usecs || (max_frames && frames >= max_frames)) {
+        virtio_coalesce_deliver(vq, irqfd);
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if (qatomic_read(&vdev->coalesce_adaptive) &&
+        now - vq->coalesce_last_ns >= (int64_t)usecs * SCALE_US) {
+        /* Sparse completions, don't add latency to them */
+        vq->coalesce_last_ns = now;
+        virtio_coalesce_deliver(vq, irqfd);
+        return;
+    }
+
+    if (!vq->coalesce_timer) {
+        vq->coalesce_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                          virtio_coalesce_timer_cb, vq);
+    }
+
+    vq->coalesce_last_ns = now + (int64_t)usecs * SCALE_US;
+    qatomic_set(&vq->coalesce_irqfd, irqfd);
+    qatomic_set(&vq->coalesce_pending, true);
+    timer_mod(vq->coalesce_timer, vq->coalesce_last_ns);
+}
+
+void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+{
+    WITH_RCU_READ_LOCK_GUARD() {
+        if (!virtio_should_notify(vdev, vq)) {
+            /*
+             * With event-idx the guest is not asking again while it waits
+             * for the held back interrupt, so check max-frames here.
+             */
+            if (qatomic_read(&vq->coalesce_pending)) {
+                virtio_coalesce_notify(vdev, vq, true);
+            }
+            return;
+        }
+    }
+
+    trace_virtio_notify_irqfd(vdev, vq);
+    virtio_coalesce_notify(vdev, vq, true);
+}
+
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
 {
     WITH_RCU_READ_LOCK_GUARD() {
         if (!virtio_should_notify(vdev, vq)) {
+            /*
+             * With event-idx the guest is not asking again while it waits
+             * for the held back interrupt, so check max-frames here.
+             */
+            if (qatomic_read(&vq->coalesce_pending)) {
+                virtio_coalesce_notify(vdev, vq, false);
+            }
             return;
         }
     }
 
     trace_virtio_notify(vdev, vq);
-    virtio_irq(vq);
+    virtio_coalesce_notify(vdev, vq, false);
 }
 
 void virtio_notify_config(VirtIODevice *vdev)
@@ -3431,6 +3662,18 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     if (!backend_run) {
         virtio_set_status(vdev, vdev->status);
     }
+
+    if (!running) {
+        int i;
+
+        /* Don't leave interrupts behind in a saved or migrated state */
+        for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+            if (vdev->vq[i].vring.num == 0) {
+                break;
+            }
+            virtio_coalesce_flush(&vdev->vq[i]);
+        }
+    }
 }
 
 void virtio_instance_init_common(Object *proxy_obj, void *data,
@@ -3991,6 +4234,7 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
             break;
         }
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
+        g_clear_pointer(&vdev->vq[i].coalesce_timer, timer_free);
     }
     g_free(vdev->vq);
 }
@@ -4014,6 +4258,63 @@ static Property virtio_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static void virtio_device_get_coalesce_usecs(Object *obj, Visitor *v,
+                                             const char *name, void *opaque,
+                                             Error **errp)
+{
+    uint32_t value = qatomic_read(&VIRTIO_DEVICE(obj)->coalesce_usecs);
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void virtio_device_set_coalesce_usecs(Object *obj, Visitor *v,
+                                             const char *name, void *opaque,
+                                             Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > 1000000) {
+        error_setg(errp, "'%s' must not exceed 1000000", name);
+        return;
+    }
+    qatomic_set(&VIRTIO_DEVICE(obj)->coalesce_usecs, value);
+}
+
+static void virtio_device_get_coalesce_max_frames(Object *obj, Visitor *v,
+                                                  const char *name,
+                                                  void *opaque, Error **errp)
+{
+    uint32_t value = qatomic_read(&VIRTIO_DEVICE(obj)->coalesce_max_frames);
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void virtio_device_set_coalesce_max_frames(Object *obj, Visitor *v,
+                                                  const char *name,
+                                                  void *opaque, Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    qatomic_set(&VIRTIO_DEVICE(obj)->coalesce_max_frames, value);
+}
+
+static bool virtio_device_get_coalesce_adaptive(Object *obj, Error **errp)
+{
+    return qatomic_read(&VIRTIO_DEVICE(obj)->coalesce_adaptive);
+}
+
+static void virtio_device_set_coalesce_adaptive(Object *obj, bool value,
+                                                Error **errp)
+{
+    qatomic_set(&VIRTIO_DEVICE(obj)->coalesce_adaptive, value);
+}
+
 static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
@@ -4148,6 +4449,29 @@ static void virtio_device_class_init(ObjectClass *klass, void *data)
     vdc->stop_ioeventfd = virtio_device_stop_ioeventfd_impl;
 
     vdc->legacy_features |= VIRTIO_LEGACY_FEATURES;
+
+    /* Not qdev properties, so that they can be tuned at runtime */
+    object_class_property_add(klass, "coalesce-usecs", "uint32",
+                              virtio_device_get_coalesce_usecs,
+                              virtio_device_set_coalesce_usecs, NULL, NULL);
+    object_class_property_set_description(klass, "coalesce-usecs",
+        "Maximum time in microseconds a queue interrupt may be delayed to "
+        "coalesce it with later ones (0 = off)");
+    object_class_property_add(klass, "coalesce-max-frames", "uint32",
+                              virtio_device_get_coalesce_max_frames,
+                              virtio_device_set_coalesce_max_frames,
+                              NULL, NULL);
+    object_class_property_set_description(klass, "coalesce-max-frames",
+        "Send the interrupt once this many completions are pending "
+        "(0 = no limit)");
+    object_class_property_add_bool(klass, "coalesce-adaptive",
+                                   virtio_device_get_coalesce_adaptive,
+                                   virtio_device_set_coalesce_adaptive);
+    object_class_property_set_description(klass, "coalesce-adaptive",
+        "Only coalesce interrupts that follow the previous one within "
+        "coalesce-usecs");
+
+    virtio_stats_register();
 }
 
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev)
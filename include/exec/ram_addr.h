@@ -30,6 +30,30 @@
 
 extern uint64_t total_dirty_pages;
 
+/* Number of guest pages covered by one bit of RAMBlock.bmap_summary */
+#define BMAP_SUMMARY_SHIFT 9
+
+/**
+ * bmap_summary_set: mark the page range as possibly dirty in the summary
+ * bitmap.  Must be with bitmap_mutex held.
+ *
+ * @rb: the ramblock to operate on
+ * @start: the start page number
+ * @npages: number of pages in the range
+ *
+ * Returns: None
+ */
+static inline void bmap_summary_set(RAMBlock *rb, uint64_t start,
+                                    uint64_t npages)
+{
+    uint64_t first = start >> BMAP_SUMMARY_SHIFT;
+    uint64_t last = (start + npages - 1) >> BMAP_SUMMARY_SHIFT;
+
+    if (rb->bmap_summary && npages) {
+        bitmap_set(rb->bmap_summary, first, last - first + 1);
+    }
+}
+
 /**
  * clear_bmap_size: calculate clear bitmap size
  *
@@ -507,6 +531,10 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                 dest[k] |= bits;
                 new_dirty &= bits;
                 num_dirty += ctpopl(new_dirty);
+                if (rb->bmap_summary) {
+                    set_bit((k * BITS_PER_LONG) >> BMAP_SUMMARY_SHIFT,
+                            rb->bmap_summary);
+                }
             }
 
             if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
@@ -541,6 +569,7 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                 long k = (start + addr) >> TARGET_PAGE_BITS;
                 if (!test_and_set_bit(k, dest)) {
                     num_dirty++;
+                    bmap_summary_set(rb, k, 1);
                 }
             }
         }
@@ -45,6 +45,15 @@ struct RAMBlock {
     size_t page_size;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
+    /*
+     * Summary of bmap, one bit per chunk of (1 << BMAP_SUMMARY_SHIFT)
+     * guest pages.  A chunk may only have dirty bits in bmap if its bit is
+     * set here; bits are set together with bmap and lazily cleared when a
+     * search finds the chunk clean, which lets searches skip large clean
+     * areas without scanning bmap.  Only allocated on the migration
+     * source, protected by the global ram_state.bitmap_mutex like bmap.
+     */
+    unsigned long *bmap_summary;
 
     /*
      * Below fields are only used by mapped-ram migration
@@ -141,6 +141,14 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Number of times this TB has been entered.  Only maintained by the
+     * generated code if tb-exec-count was enabled when the TB was
+     * translated; the update is not atomic, so with MTTCG the count
+     * is approximate.
+     */
+    uint64_t exec_count;
 };
 
 /* The alignment given to TranslationBlock during allocation. */
@@ -274,8 +274,8 @@ typedef struct CPUTLBDesc {
     /*
      * Describe a region covering all of the large pages allocated
      * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * we must search the tlb for entries of the large pages hit.
+     * The region is matched if (addr & large_page_mask) == large_page_addr.
      */
     vaddr large_page_addr;
     vaddr large_page_mask;
@@ -133,6 +133,29 @@ typedef struct VirtioNetRscChain {
     VirtioNetRscStat stat;
 } VirtioNetRscChain;
 
+/* Software GRO, parsed headers of a TCP segment */
+typedef struct VirtioNetGroUnit {
+    uint8_t *ip;            /* ip header */
+    uint16_t ip_hdrlen;
+    uint8_t *addrs;         /* source and destination addresses */
+    uint16_t addr_size;
+    struct tcp_header *tcp; /* tcp header */
+    uint16_t tcp_hdrlen;
+    uint16_t payload;       /* pure payload without eth/ip/tcp */
+} VirtioNetGroUnit;
+
+/* Software GRO flow, one slot of the flow hash table */
+typedef struct VirtioNetGroFlow {
+    NetClientState *nc;     /* NULL if the slot is free */
+    uint8_t *buf;           /* eth/ip/tcp headers and coalesced payload */
+    size_t size;
+    uint16_t proto;
+    uint16_t mss;
+    uint16_t segs;
+    uint32_t next_seq;
+    VirtioNetGroUnit unit;
+} VirtioNetGroFlow;
+
 /* Maximum packet size we can receive from tap device: header + 64k */
 #define VIRTIO_NET_MAX_BUFSIZE (sizeof(struct virtio_net_hdr) + (64 * KiB))
 
@@ -159,7 +182,11 @@ typedef struct VirtIONetQueue {
     uint32_t tx_waiting;
     struct {
         VirtQueueElement *elem;
+        /* Segments of elem still queued by the peer (sw-tx-offload) */
+        unsigned int segs;
     } async_tx;
+    /* RX buffers filled but not yet published while batching */
+    unsigned int rx_unflushed;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
@@ -182,6 +209,13 @@ struct VirtIONet {
     uint32_t rsc_timeout;
     uint8_t rsc4_enabled;
     uint8_t rsc6_enabled;
+    uint8_t gro4_enabled;
+    uint8_t gro6_enabled;
+    VirtioNetGroFlow *gro_flows;
+    /* header given to the guest for the packet being delivered, if any */
+    struct virtio_net_hdr *gro_hdr;
+    /* a GRO packet is waiting for guest buffers, see gro_flush_flow */
+    bool gro_stalled;
     uint8_t has_ufo;
     uint32_t mergeable_rx_bufs;
     uint8_t promisc;
@@ -215,6 +249,12 @@ struct VirtIONet {
     AnnounceTimer announce_timer;
     bool needs_vnet_hdr_swap;
     bool mtu_bypass_backend;
+    /* offer TX offloads to the guest and emulate them if the peer can't */
+    bool sw_tx_offload;
+    /* offer RX offloads to the guest and coalesce TCP flows for them */
+    bool sw_rx_offload;
+    /* nesting depth of receive batches from the backend */
+    unsigned int rx_batch;
     /* primary failover device is hidden*/
     bool failover_primary_hidden;
     bool failover;
@@ -224,6 +264,7 @@ struct VirtIONet {
     NotifierWithReturn migration_state;
     VirtioNetRssData rss_data;
     struct NetRxPkt *rx_pkt;
+    struct NetTxPkt *tx_pkt;
     struct EBPFRSSContext ebpf_rss;
     uint32_t nr_ebpf_rss_fds;
     char **ebpf_rss_fds;
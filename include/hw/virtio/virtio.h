@@ -23,6 +23,7 @@
 #include "standard-headers/linux/virtio_ring.h"
 #include "qom/object.h"
 #include "block/aio.h"
+#include "qemu/stats64.h"
 
 /*
  * A guest should never accept this. It implies negotiation is broken
@@ -167,6 +168,20 @@ struct VirtIODevice
      */
     EventNotifier config_notifier;
     bool device_iotlb_enabled;
+    /**
+     * @coalesce_usecs: how long a queue notification may be held back so
+     * that later ones are folded into the same interrupt, 0 to disable.
+     * @coalesce_max_frames: deliver at once when this many used ring
+     * completions are pending, 0 for no limit.  @coalesce_adaptive: only hold back
+     * notifications that follow the previous interrupt within
+     * @coalesce_usecs.  All three can be changed at runtime with qom-set.
+     */
+    uint32_t coalesce_usecs;
+    uint32_t coalesce_max_frames;
+    bool coalesce_adaptive;
+    /* Used ring completions, and queue interrupts sent for them */
+    Stat64 completions;
+    Stat64 interrupts;
 };
 
 struct VirtioDeviceClass {
@@ -268,6 +283,8 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
 
 void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem);
 void *virtqueue_pop(VirtQueue *vq, size_t sz);
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max);
 unsigned int virtqueue_drop_all(VirtQueue *vq);
 void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz);
 void qemu_put_virtqueue_element(VirtIODevice *vdev, QEMUFile *f,
@@ -282,6 +299,7 @@ int virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
                               unsigned int *out_bytes, unsigned max_in_bytes,
                               unsigned max_out_bytes);
 
+bool virtio_should_notify(VirtIODevice *vdev, VirtQueue *vq);
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq);
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq);
 
@@ -49,6 +49,7 @@ typedef int (NetLoad)(NetClientState *);
 typedef void (NetStop)(NetClientState *);
 typedef ssize_t (NetReceive)(NetClientState *, const uint8_t *, size_t);
 typedef ssize_t (NetReceiveIOV)(NetClientState *, const struct iovec *, int);
+typedef void (NetReceiveBatch)(NetClientState *, bool begin);
 typedef void (NetCleanup) (NetClientState *);
 typedef void (LinkStatusChanged)(NetClientState *);
 typedef void (NetClientDestructor)(NetClientState *);
@@ -74,6 +75,7 @@ typedef struct NetClientInfo {
     NetReceive *receive;
     NetReceiveIOV *receive_iov;
     NetCanReceive *can_receive;
+    NetReceiveBatch *receive_batch;
     NetStart *start;
     NetLoad *load;
     NetStop *stop;
@@ -178,6 +180,8 @@ ssize_t qemu_send_packet_async(NetClientState *nc, const uint8_t *buf,
 void qemu_purge_queued_packets(NetClientState *nc);
 void qemu_flush_queued_packets(NetClientState *nc);
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge);
+void qemu_net_batch_begin(NetClientState *nc);
+void qemu_net_batch_end(NetClientState *nc);
 void qemu_set_info_str(NetClientState *nc,
                        const char *fmt, ...) G_GNUC_PRINTF(2, 3);
 void qemu_format_nic_info_str(NetClientState *nc, uint8_t macaddr[6]);
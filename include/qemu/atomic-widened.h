@@ -0,0 +1,103 @@
+/*
+ * Misaligned atomic operations widened to the containing host word
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_ATOMIC_WIDENED_H
+#define QEMU_ATOMIC_WIDENED_H
+
+#include "qemu/atomic128.h"
+#include "exec/vaddr.h"
+
+#ifdef CONFIG_ATOMIC64
+# define ATOMIC_WIDENED_AL8  true
+#else
+# define ATOMIC_WIDENED_AL8  false
+#endif
+
+/**
+ * atomic_widened_ok:
+ * @addr: address of the operation
+ * @size: size of the operation
+ *
+ * Return true if an atomic read-modify-write of @size bytes at the
+ * misaligned @addr lies within one aligned host word for which we
+ * have a compare-and-swap, so that it can be performed by
+ * atomic_cmpxchg_widened instead of stopping the world.
+ */
+static inline bool atomic_widened_ok(vaddr addr, int size)
+{
+    if (ATOMIC_WIDENED_AL8 && (addr & 7) + size <= 8) {
+        return true;
+    }
+    return HAVE_CMPXCHG128 && (addr & 15) + size <= 16;
+}
+
+/**
+ * atomic_cmpxchg_widened:
+ * @pv: host address
+ * @cmpv: expected contents
+ * @newv: new contents
+ * @oldv: returns the previous contents
+ * @size: number of bytes
+ *
+ * Atomically compare-and-swap the @size bytes at @pv, which must
+ * satisfy atomic_widened_ok, by way of a compare-and-swap loop on
+ * the containing aligned 8 or 16 bytes.  All of @cmpv, @newv and
+ * @oldv are in host memory order.  Like qatomic_cmpxchg, this is
+ * a full barrier.
+ */
+static inline void atomic_cmpxchg_widened(void *pv, const void *cmpv,
+                                   const void *newv, void *oldv, int size)
+{
+    uintptr_t o = (uintptr_t)pv & 7;
+
+    if (ATOMIC_WIDENED_AL8 && o + size <= 8) {
+        uint64_t *p = __builtin_assume_aligned(pv - o, 8);
+        uint64_t old, new, cur;
+
+        smp_mb();
+        cur = qatomic_read__nocheck(p);
+        do {
+            old = cur;
+            memcpy(oldv, (uint8_t *)&old + o, size);
+            if (memcmp(oldv, cmpv, size) != 0) {
+                smp_mb();
+                return;
+            }
+            new = old;
+            memcpy((uint8_t *)&new + o, newv, size);
+            cur = qatomic_cmpxchg__nocheck(p, old, new);
+        } while (cur != old);
+        return;
+    }
+
+#if HAVE_CMPXCHG128
+    o = (uintptr_t)pv & 15;
+    if (o + size <= 16) {
+        Int128 *p = __builtin_assume_aligned(pv - o, 16);
+        Int128 old, new, cur;
+
+        /* A compare-and-swap of zero with zero is an atomic read. */
+        cur = atomic16_cmpxchg(p, int128_zero(), int128_zero());
+        do {
+            old = cur;
+            memcpy(oldv, (uint8_t *)&old + o, size);
+            if (memcmp(oldv, cmpv, size) != 0) {
+                return;
+            }
+            new = old;
+            memcpy((uint8_t *)&new + o, newv, size);
+            cur = atomic16_cmpxchg(p, old, new);
+        } while (int128_ne(cur, old));
+        return;
+    }
+#endif
+    g_assert_not_reached();
+}
+
+#endif /* QEMU_ATOMIC_WIDENED_H */
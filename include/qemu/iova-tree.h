@@ -128,6 +128,17 @@ const DMAMap *iova_tree_find_iova(const IOVATree *tree, const DMAMap *map);
 int iova_tree_alloc_map(IOVATree *tree, DMAMap *map, hwaddr iova_begin,
                         hwaddr iova_end);
 
+/**
+ * iova_tree_generation:
+ *
+ * @tree: the iova tree
+ *
+ * Return: a counter that changes every time a mapping is inserted into or
+ * removed from the tree.  Callers caching the result of a lookup by value
+ * can compare it to tell whether the cached copy may be stale.
+ */
+uint64_t iova_tree_generation(const IOVATree *tree);
+
 /**
  * iova_tree_destroy:
  *
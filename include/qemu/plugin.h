@@ -11,6 +11,7 @@
 #include "qemu/qemu-plugin.h"
 #include "qemu/error-report.h"
 #include "qemu/queue.h"
+#include "qemu/rcu.h"
 #include "qemu/option.h"
 #include "qemu/plugin-event.h"
 #include "qemu/bitmap.h"
@@ -72,6 +73,7 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_MEM_REGULAR,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
+    PLUGIN_CB_MEM_TRACE,
 };
 
 struct qemu_plugin_regular_cb {
@@ -87,6 +89,13 @@ struct qemu_plugin_inline_cb {
     enum qemu_plugin_mem_rw rw;
 };
 
+struct qemu_plugin_trace_cb {
+    struct qemu_plugin_mem_trace *trace;
+    TCGHelperInfo *info;
+    uint64_t pc;
+    enum qemu_plugin_mem_rw rw;
+};
+
 struct qemu_plugin_conditional_cb {
     union qemu_plugin_cb_sig f;
     TCGHelperInfo *info;
@@ -107,6 +116,7 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_trace_cb trace;
     };
 };
 
@@ -128,6 +138,25 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * Memory trace buffers are a scoreboard whose per-vCPU entry is a
+ * qemu_plugin_mem_trace_buf of n_records records.
+ */
+struct qemu_plugin_mem_trace {
+    struct qemu_plugin_scoreboard *score;
+    size_t n_records;
+    qemu_plugin_vcpu_mem_trace_cb_t cb;
+    enum qemu_plugin_cb_flags flags;
+    void *userdata;
+    QLIST_ENTRY(qemu_plugin_mem_trace) entry;
+    struct rcu_head rcu;
+};
+
+struct qemu_plugin_mem_trace_buf {
+    uint64_t count;
+    qemu_plugin_mem_record records[];
+};
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
@@ -171,6 +200,10 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              uint64_t value_high,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw);
 
+void qemu_plugin_mem_trace_drain(unsigned int vcpu_index, void *trace);
+
+void qemu_plugin_tb_exit(CPUState *cpu);
+
 void qemu_plugin_flush_cb(void);
 
 void qemu_plugin_atexit_cb(void);
@@ -259,6 +292,9 @@ static inline void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                            enum qemu_plugin_mem_rw rw)
 { }
 
+static inline void qemu_plugin_tb_exit(CPUState *cpu)
+{ }
+
 static inline void qemu_plugin_flush_cb(void)
 { }
 
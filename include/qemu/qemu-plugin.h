@@ -65,11 +65,15 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * version 4:
  * - added qemu_plugin_read_memory_vaddr
+ *
+ * version 5:
+ * - added memory trace buffers (qemu_plugin_mem_trace_new and
+ *   qemu_plugin_register_vcpu_mem_trace)
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 4
+#define QEMU_PLUGIN_VERSION 5
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -701,6 +705,98 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/**
+ * typedef qemu_plugin_mem_record - one memory access in a trace buffer
+ * @vaddr: the virtual address of the transaction
+ * @pc: the virtual address of the instruction performing it
+ * @info: an opaque handle for further queries about the memory
+ */
+typedef struct {
+    uint64_t vaddr;
+    uint64_t pc;
+    qemu_plugin_meminfo_t info;
+} qemu_plugin_mem_record;
+
+/** struct qemu_plugin_mem_trace - Opaque handle for a memory trace */
+struct qemu_plugin_mem_trace;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_trace_cb_t - memory trace callback type
+ * @vcpu_index: the vCPU whose buffer is delivered
+ * @records: the buffered accesses, oldest first
+ * @n: number of records
+ * @userdata: any user data attached to the trace
+ */
+typedef void (*qemu_plugin_vcpu_mem_trace_cb_t)(
+    unsigned int vcpu_index,
+    const qemu_plugin_mem_record *records,
+    size_t n,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_trace_new() - allocate per-vCPU memory trace buffers
+ * @n_records: capacity of each vCPU's buffer
+ * @cb: callback of type qemu_plugin_vcpu_mem_trace_cb_t
+ * @flags: does the callback read or write the CPU's registers?
+ * @userdata: opaque pointer passed to @cb
+ *
+ * Each vCPU gets a buffer of @n_records records. @cb is called from
+ * the vCPU thread whenever the buffer fills, at the end of each
+ * translation block that appended records, and by
+ * qemu_plugin_mem_trace_flush(). Records of a block left early, e.g.
+ * by an exception, are delivered at the end of the next block that
+ * runs on the vCPU.
+ *
+ * Returns a handle that must be freed with qemu_plugin_mem_trace_free().
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_trace *
+qemu_plugin_mem_trace_new(size_t n_records,
+                          qemu_plugin_vcpu_mem_trace_cb_t cb,
+                          enum qemu_plugin_cb_flags flags,
+                          void *userdata);
+
+/**
+ * qemu_plugin_mem_trace_free() - free a memory trace
+ * @trace: trace to free
+ *
+ * Records still buffered are discarded.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace);
+
+/**
+ * qemu_plugin_mem_trace_flush() - deliver the records buffered for a vCPU
+ * @trace: trace to flush
+ * @vcpu_index: vCPU whose buffer to flush
+ *
+ * Call the trace callback with any records buffered for @vcpu_index.
+ * This must be called from a callback running on that vCPU (e.g. the
+ * vcpu_exit callback), or once all vCPUs are stopped (e.g. at exit).
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_trace_flush(struct qemu_plugin_mem_trace *trace,
+                                 unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_register_vcpu_mem_trace() - trace memory accesses to a buffer
+ * @insn: handle for instruction to instrument
+ * @rw: trace reads, writes or both
+ * @trace: trace buffers to append to
+ *
+ * Generated code appends a qemu_plugin_mem_record for every memory
+ * access of the instruction to the executing vCPU's buffer, without
+ * leaving generated code until the end of the block. This is much
+ * cheaper than qemu_plugin_register_vcpu_mem_cb(), at the cost of
+ * delivering accesses late: queries that depend on the state at the
+ * time of the access, such as qemu_plugin_get_hwaddr() or
+ * qemu_plugin_mem_get_value(), cannot be used on the records.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_trace *trace);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
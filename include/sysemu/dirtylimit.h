@@ -36,4 +36,5 @@ void dirtylimit_set_all(uint64_t quota,
 void dirtylimit_vcpu_execute(CPUState *cpu);
 uint64_t dirtylimit_throttle_time_per_round(void);
 uint64_t dirtylimit_ring_full_time(void);
+uint64_t dirtylimit_calc_fair_quota(uint64_t budget);
 #endif
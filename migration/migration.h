@@ -455,6 +455,21 @@ struct MigrationState {
      * (which is in 4M chunk).
      */
     uint8_t clear_bitmap_shift;
+    /*
+     * Destination side only.  When non-zero, the postcopy fault thread
+     * tracks the fault addresses of each vCPU and, once a sequential or
+     * strided access pattern has been confirmed, speculatively requests up
+     * to this many host pages ahead of the faulting page.  Zero (the
+     * default) only ever requests the faulted page.
+     */
+    uint8_t postcopy_prefetch_pages;
+    /*
+     * Only used with the dirty-limit capability.  When set, the dirty page
+     * rate quota is derived from the measured per-vCPU dirty page rates and
+     * the migration bandwidth, so that only the vCPUs writing the most are
+     * throttled.  vcpu-dirty-limit is then a lower bound for the quota.
+     */
+    bool dirty_limit_adaptive;
 
     /*
      * This save hostname when out-going migration starts
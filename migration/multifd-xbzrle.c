@@ -0,0 +1,491 @@
+/*
+ * Multifd XBZRLE delta compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/xxhash.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+#include "xbzrle.h"
+
+/*
+ * Each channel keeps its own cache of the last contents it sent (source)
+ * or received (destination) for a set of pages.  Both sides see the same
+ * sequence of pages on a given channel and use the same deterministic
+ * replacement policy, so their caches always hold the same contents and
+ * pages that hit in the cache can be sent as an XBZRLE delta against it.
+ * A page that moves between channels is simply encoded against whatever
+ * the new channel last saw of it.
+ *
+ * The cache is set-associative: a page can live in any of the ways of the
+ * set selected by hashing its offset, and the least recently used way of
+ * the set is replaced on a miss.
+ *
+ * The sender also indexes the cache by content.  A page that misses but
+ * whose contents are already cached for another page (a generalization of
+ * zero page detection to any known content) is sent as a reference to that
+ * cache entry, and the receiver copies it out of its own cache.  Only the
+ * channel's own cache is searched: there is no index shared with other
+ * migrations, so identical guests migrating to one host are not
+ * deduplicated against each other.
+ */
+#define MULTIFD_XBZRLE_CACHE_WAYS 4
+
+/*
+ * Per page length word of the packet payload.  Pages that hit in the
+ * cache carry this flag and an XBZRLE encoded delta, all the others are
+ * sent in full.
+ */
+#define MULTIFD_XBZRLE_DELTA (1U << 31)
+/*
+ * Pages carrying this flag have no data, the low bits of the length word
+ * are the index of the cache entry holding the same contents.
+ */
+#define MULTIFD_XBZRLE_DUP (1U << 30)
+#define MULTIFD_XBZRLE_LEN_MASK (MULTIFD_XBZRLE_DUP - 1)
+
+typedef struct {
+    /* NULL if the entry is not in use */
+    RAMBlock *block;
+    ram_addr_t offset;
+    /* value of the cache clock at the last access */
+    uint64_t age;
+    /* last contents of the page seen on this channel */
+    uint8_t *data;
+} XbzrleCacheEntry;
+
+typedef struct {
+    /* number of sets, a power of 2 */
+    uint32_t num_sets;
+    uint64_t clock;
+    XbzrleCacheEntry *entries;
+    uint8_t *data;
+    /*
+     * Sender only: entry index of the last page cached with each content
+     * hash.  It is only a hint, matches are verified against the entry.
+     */
+    uint32_t *content_index;
+} XbzrleCache;
+
+typedef struct {
+    /* number of sets of the sender cache, so the receiver can match it */
+    uint32_t cache_sets;
+    uint32_t unused;
+    /* length and MULTIFD_XBZRLE_DELTA flag of each normal page */
+    uint32_t len[];
+} __attribute__((packed)) XbzrleHeader;
+
+struct xbzrle_data {
+    XbzrleCache cache;
+    /* header of the current packet */
+    XbzrleHeader *hdr;
+    /* encoded pages of the current packet */
+    uint8_t *buf;
+    /* stable copy of the page being encoded */
+    uint8_t *page;
+};
+
+static bool xbzrle_cache_init(XbzrleCache *cache, uint32_t num_sets,
+                              Error **errp)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    size_t num = (size_t)num_sets * MULTIFD_XBZRLE_CACHE_WAYS;
+    size_t i;
+
+    cache->data = g_try_malloc(num * page_size);
+    if (!cache->data) {
+        error_setg(errp, "out of memory for xbzrle cache");
+        return false;
+    }
+    cache->entries = g_new0(XbzrleCacheEntry, num);
+    for (i = 0; i < num; i++) {
+        cache->entries[i].data = cache->data + i * page_size;
+    }
+    cache->num_sets = num_sets;
+    cache->clock = 0;
+
+    return true;
+}
+
+static void xbzrle_cache_cleanup(XbzrleCache *cache)
+{
+    g_free(cache->content_index);
+    cache->content_index = NULL;
+    g_free(cache->entries);
+    cache->entries = NULL;
+    g_free(cache->data);
+    cache->data = NULL;
+    cache->num_sets = 0;
+}
+
+/*
+ * Return the entry caching @offset of @block.  On a miss, the least
+ * recently used way of the set is claimed for the page and *hit is set to
+ * false; the caller then has to fill its data.
+ */
+static XbzrleCacheEntry *xbzrle_cache_get(XbzrleCache *cache, RAMBlock *block,
+                                          ram_addr_t offset, bool *hit)
+{
+    uint32_t set = qemu_xxhash2(offset) & (cache->num_sets - 1);
+    XbzrleCacheEntry *e = &cache->entries[set * MULTIFD_XBZRLE_CACHE_WAYS];
+    XbzrleCacheEntry *victim = e;
+    int i;
+
+    cache->clock++;
+    for (i = 0; i < MULTIFD_XBZRLE_CACHE_WAYS; i++) {
+        if (e[i].block == block && e[i].offset == offset) {
+            e[i].age = cache->clock;
+            *hit = true;
+            return &e[i];
+        }
+        if (e[i].age < victim->age) {
+            victim = &e[i];
+        }
+    }
+
+    victim->block = block;
+    victim->offset = offset;
+    victim->age = cache->clock;
+    *hit = false;
+
+    return victim;
+}
+
+static uint32_t xbzrle_cache_num_entries(XbzrleCache *cache)
+{
+    return cache->num_sets * MULTIFD_XBZRLE_CACHE_WAYS;
+}
+
+/*
+ * Cheap hash of a few words spread over the page, only used to find
+ * candidates in the content index.
+ */
+static uint32_t xbzrle_content_hash(const uint8_t *page, uint32_t page_size)
+{
+    return qemu_xxhash7(ldq_he_p(page),
+                        ldq_he_p(page + page_size / 4),
+                        ldq_he_p(page + page_size / 2),
+                        ldl_he_p(page + page_size - 4));
+}
+
+/* Find a cached entry whose contents are @page */
+static XbzrleCacheEntry *xbzrle_cache_find_content(XbzrleCache *cache,
+                                                   const uint8_t *page,
+                                                   uint32_t hash)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t n = xbzrle_cache_num_entries(cache);
+    XbzrleCacheEntry *e = &cache->entries[cache->content_index[hash & (n - 1)]];
+
+    if (e->block && !memcmp(e->data, page, page_size)) {
+        return e;
+    }
+
+    return NULL;
+}
+
+/* Multifd xbzrle compression */
+
+static int multifd_xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t page_count = multifd_ram_page_count();
+    uint64_t pages = migrate_xbzrle_cache_size() / page_size /
+                     migrate_multifd_channels();
+    uint32_t num_sets = MAX(pow2floor(pages / MULTIFD_XBZRLE_CACHE_WAYS), 1);
+
+    if (!xbzrle_cache_init(&z->cache, num_sets, errp)) {
+        g_free(z);
+        error_prepend(errp, "multifd %u: ", p->id);
+        return -1;
+    }
+    z->cache.content_index = g_new0(uint32_t,
+                                    xbzrle_cache_num_entries(&z->cache));
+    z->hdr = g_malloc0(sizeof(XbzrleHeader) + page_count * sizeof(uint32_t));
+    z->buf = g_try_malloc(MULTIFD_PACKET_SIZE);
+    if (!z->buf) {
+        g_free(z->hdr);
+        xbzrle_cache_cleanup(&z->cache);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for buf", p->id);
+        return -1;
+    }
+    z->page = g_malloc(page_size);
+    p->compress_data = z;
+
+    /*
+     * Needs 3 IOVs, one for packet header, one for the page lengths and
+     * one for the encoded pages
+     */
+    p->iov = g_new0(struct iovec, 3);
+
+    return 0;
+}
+
+static void multifd_xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->compress_data;
+
+    xbzrle_cache_cleanup(&z->cache);
+    g_free(z->hdr);
+    z->hdr = NULL;
+    g_free(z->buf);
+    z->buf = NULL;
+    g_free(z->page);
+    z->page = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct xbzrle_data *z = p->compress_data;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t num_entries = xbzrle_cache_num_entries(&z->cache);
+    uint32_t out_size = 0, hdr_size, delta_pages = 0, dup_pages = 0;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto out;
+    }
+
+    z->hdr->cache_sets = cpu_to_be32(z->cache.num_sets);
+    for (i = 0; i < pages->normal_num; i++) {
+        XbzrleCacheEntry *e, *dup;
+        uint32_t hash;
+        bool hit;
+        int len = -1;
+
+        /*
+         * The page may be changing concurrently, take a stable copy so that
+         * the cache ends up with exactly what we sent.
+         */
+        memcpy(z->page, pages->block->host + pages->offset[i], page_size);
+        hash = xbzrle_content_hash(z->page, page_size);
+
+        /*
+         * Look for known contents before claiming an entry for the page, as
+         * that may evict the matching entry.  The receiver resolves the
+         * reference in the same order.
+         */
+        dup = xbzrle_cache_find_content(&z->cache, z->page, hash);
+        e = xbzrle_cache_get(&z->cache, pages->block, pages->offset[i], &hit);
+        if (hit) {
+            len = xbzrle_encode_buffer(e->data, z->page, page_size,
+                                       z->buf + out_size, page_size);
+        }
+        if (len >= 0) {
+            z->hdr->len[i] = cpu_to_be32(len | MULTIFD_XBZRLE_DELTA);
+            delta_pages++;
+        } else if (dup) {
+            len = 0;
+            z->hdr->len[i] = cpu_to_be32((dup - z->cache.entries) |
+                                         MULTIFD_XBZRLE_DUP);
+            dup_pages++;
+        } else {
+            /* Cache miss or delta overflow, send the full page */
+            len = page_size;
+            memcpy(z->buf + out_size, z->page, page_size);
+            z->hdr->len[i] = cpu_to_be32(len);
+        }
+        memcpy(e->data, z->page, page_size);
+        z->cache.content_index[hash & (num_entries - 1)] = e - z->cache.entries;
+        out_size += len;
+    }
+
+    hdr_size = sizeof(XbzrleHeader) + pages->normal_num * sizeof(uint32_t);
+    p->iov[p->iovs_num].iov_base = z->hdr;
+    p->iov[p->iovs_num].iov_len = hdr_size;
+    p->iovs_num++;
+    p->iov[p->iovs_num].iov_base = z->buf;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = hdr_size + out_size;
+
+    trace_multifd_xbzrle_send(p->id, pages->normal_num, delta_pages,
+                              dup_pages, out_size);
+
+out:
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+    uint32_t page_count = multifd_ram_page_count();
+
+    /* The cache is allocated once the sender tells us its geometry */
+    z->hdr = g_malloc0(sizeof(XbzrleHeader) + page_count * sizeof(uint32_t));
+    z->buf = g_try_malloc(MULTIFD_PACKET_SIZE);
+    if (!z->buf) {
+        g_free(z->hdr);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for buf", p->id);
+        return -1;
+    }
+    p->compress_data = z;
+
+    return 0;
+}
+
+static void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *z = p->compress_data;
+
+    xbzrle_cache_cleanup(&z->cache);
+    g_free(z->hdr);
+    z->hdr = NULL;
+    g_free(z->buf);
+    z->buf = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_xbzrle_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t hdr_size, data_size, cache_sets, pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    hdr_size = sizeof(XbzrleHeader) + p->normal_num * sizeof(uint32_t);
+    if (in_size < hdr_size || in_size - hdr_size > MULTIFD_PACKET_SIZE) {
+        error_setg(errp, "multifd %u: packet size %u invalid for %u pages",
+                   p->id, in_size, p->normal_num);
+        return -1;
+    }
+    data_size = in_size - hdr_size;
+
+    ret = qio_channel_read_all(p->c, (void *)z->hdr, hdr_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    cache_sets = be32_to_cpu(z->hdr->cache_sets);
+    if (!z->cache.num_sets) {
+        if (!cache_sets || !is_power_of_2(cache_sets)) {
+            error_setg(errp, "multifd %u: invalid xbzrle cache geometry %u",
+                       p->id, cache_sets);
+            return -1;
+        }
+        if (!xbzrle_cache_init(&z->cache, cache_sets, errp)) {
+            error_prepend(errp, "multifd %u: ", p->id);
+            return -1;
+        }
+    } else if (cache_sets != z->cache.num_sets) {
+        error_setg(errp, "multifd %u: xbzrle cache geometry changed from %u "
+                   "to %u", p->id, z->cache.num_sets, cache_sets);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)z->buf, data_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t len = be32_to_cpu(z->hdr->len[i]);
+        bool delta = len & MULTIFD_XBZRLE_DELTA;
+        bool dup = len & MULTIFD_XBZRLE_DUP;
+        XbzrleCacheEntry *e, *src = NULL;
+        bool hit;
+
+        len &= MULTIFD_XBZRLE_LEN_MASK;
+        if (dup) {
+            if (delta || len >= xbzrle_cache_num_entries(&z->cache) ||
+                !z->cache.entries[len].block) {
+                error_setg(errp, "multifd %u: invalid cache reference %u",
+                           p->id, len);
+                return -1;
+            }
+            /* Resolve the reference before the page claims its own entry */
+            src = &z->cache.entries[len];
+            len = 0;
+        } else if (len > data_size - pos || (!delta && len != page_size)) {
+            error_setg(errp, "multifd %u: invalid page length %u", p->id, len);
+            return -1;
+        }
+
+        e = xbzrle_cache_get(&z->cache, p->block, p->normal[i], &hit);
+        if (src) {
+            if (src != e) {
+                memcpy(e->data, src->data, page_size);
+            }
+        } else if (delta) {
+            if (!hit) {
+                error_setg(errp, "multifd %u: xbzrle delta for uncached "
+                           "page 0x" RAM_ADDR_FMT, p->id, p->normal[i]);
+                return -1;
+            }
+            if (xbzrle_decode_buffer(z->buf + pos, len, e->data,
+                                     page_size) < 0) {
+                error_setg(errp, "multifd %u: failed to decode xbzrle page "
+                           "0x" RAM_ADDR_FMT, p->id, p->normal[i]);
+                return -1;
+            }
+        } else {
+            memcpy(e->data, z->buf + pos, page_size);
+        }
+        pos += len;
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        memcpy(p->host + p->normal[i], e->data, page_size);
+    }
+
+    if (pos != data_size) {
+        error_setg(errp, "multifd %u: packet size received %u size used %u",
+                   p->id, data_size, pos);
+        return -1;
+    }
+
+    return 0;
+}
+
+static const MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = multifd_xbzrle_send_setup,
+    .send_cleanup = multifd_xbzrle_send_cleanup,
+    .send_prepare = multifd_xbzrle_send_prepare,
+    .recv_setup = multifd_xbzrle_recv_setup,
+    .recv_cleanup = multifd_xbzrle_recv_cleanup,
+    .recv = multifd_xbzrle_recv
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
@@ -36,15 +36,24 @@ MultiFDRecvData *multifd_get_recv_data(void);
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
 
-/* We reserve 5 bits for compression methods */
-#define MULTIFD_FLAG_COMPRESSION_MASK (0x1f << 1)
+/*
+ * We reserve 5 bits for the compression method.  The field holds a single
+ * method number, not a set of bits: receivers compare the whole field.
+ * The first methods happened to be given one bit each, and keep their
+ * values for compatibility.
+ */
+#define MULTIFD_FLAG_COMPRESSION_SHIFT 1
+#define MULTIFD_FLAG_COMPRESSION_MASK (0x1f << MULTIFD_FLAG_COMPRESSION_SHIFT)
+#define MULTIFD_FLAG_COMPRESSION(method) \
+    ((method) << MULTIFD_FLAG_COMPRESSION_SHIFT)
 /* we need to be compatible. Before compression value was 0 */
-#define MULTIFD_FLAG_NOCOMP (0 << 1)
-#define MULTIFD_FLAG_ZLIB (1 << 1)
-#define MULTIFD_FLAG_ZSTD (2 << 1)
-#define MULTIFD_FLAG_QPL (4 << 1)
-#define MULTIFD_FLAG_UADK (8 << 1)
-#define MULTIFD_FLAG_QATZIP (16 << 1)
+#define MULTIFD_FLAG_NOCOMP MULTIFD_FLAG_COMPRESSION(0)
+#define MULTIFD_FLAG_ZLIB MULTIFD_FLAG_COMPRESSION(1)
+#define MULTIFD_FLAG_ZSTD MULTIFD_FLAG_COMPRESSION(2)
+#define MULTIFD_FLAG_XBZRLE MULTIFD_FLAG_COMPRESSION(3)
+#define MULTIFD_FLAG_QPL MULTIFD_FLAG_COMPRESSION(4)
+#define MULTIFD_FLAG_UADK MULTIFD_FLAG_COMPRESSION(8)
+#define MULTIFD_FLAG_QATZIP MULTIFD_FLAG_COMPRESSION(16)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
@@ -98,6 +98,10 @@ Property migration_properties[] = {
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
     DEFINE_PROP_BOOL("x-preempt-pre-7-2", MigrationState,
                      preempt_pre_7_2, false),
+    DEFINE_PROP_UINT8("x-postcopy-prefetch-pages", MigrationState,
+                      postcopy_prefetch_pages, 0),
+    DEFINE_PROP_BOOL("x-dirty-limit-adaptive", MigrationState,
+                     dirty_limit_adaptive, false),
 
     /* Migration parameters */
     DEFINE_PROP_UINT8("x-throttle-trigger-threshold", MigrationState,
@@ -355,6 +359,20 @@ bool migrate_multifd_flush_after_each_section(void)
     return s->multifd_flush_after_each_section;
 }
 
+uint8_t migrate_postcopy_prefetch_pages(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->postcopy_prefetch_pages;
+}
+
+bool migrate_dirty_limit_adaptive(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->dirty_limit_adaptive;
+}
+
 bool migrate_postcopy(void)
 {
     return migrate_postcopy_ram() || migrate_dirty_bitmaps();
@@ -49,8 +49,10 @@ bool migrate_zero_copy_send(void);
  * check, but they are not a capability.
  */
 
+bool migrate_dirty_limit_adaptive(void);
 bool migrate_multifd_flush_after_each_section(void);
 bool migrate_postcopy(void);
+uint8_t migrate_postcopy_prefetch_pages(void);
 bool migrate_rdma(void);
 bool migrate_tls(void);
 
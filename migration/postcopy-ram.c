@@ -943,6 +943,127 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
                                       affected_cpu);
 }
 
+/*
+ * Largest distance, in host pages, between two consecutive faults of one
+ * vCPU that is still considered part of the same strided stream.
+ */
+#define POSTCOPY_PREFETCH_MAX_STRIDE 64
+
+/*
+ * Per-vCPU fault stream tracked by the fault thread for prefetching.  Only
+ * the fault thread touches these, so no locking is needed.
+ */
+typedef struct PostcopyPrefetchStream {
+    RAMBlock *rb;
+    /* Offset in @rb of the last fault seen for this stream */
+    ram_addr_t last_offset;
+    /* Distance in bytes between faults, 0 if no pattern detected yet */
+    int64_t stride;
+    /* Next offset in @rb to prefetch, or -1 if nothing prefetched yet */
+    int64_t next_offset;
+} PostcopyPrefetchStream;
+
+static PostcopyPrefetchStream *postcopy_prefetch_streams_new(void)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    PostcopyPrefetchStream *streams;
+    int i;
+
+    /*
+     * One per possible vCPU (hotplugged ones get an index up to max_cpus),
+     * plus one for faults we cannot attribute to a vCPU
+     */
+    streams = g_new0(PostcopyPrefetchStream, ms->smp.max_cpus + 1);
+    for (i = 0; i <= ms->smp.max_cpus; i++) {
+        streams[i].next_offset = -1;
+    }
+
+    return streams;
+}
+
+static PostcopyPrefetchStream *
+postcopy_prefetch_stream_get(PostcopyPrefetchStream *streams, uint32_t ptid)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    int cpu = ptid ? get_mem_fault_cpu_index(ptid) : -1;
+
+    if (cpu < 0 || cpu >= ms->smp.max_cpus) {
+        cpu = ms->smp.max_cpus;
+    }
+    return &streams[cpu];
+}
+
+/*
+ * Called from the fault thread after the faulted page at @offset has been
+ * requested.  If the previous faults of this stream form a sequential or
+ * strided pattern, ask the source for the next pages of the stream too, so
+ * that the vCPU will not have to take a round trip for each of them.
+ *
+ * Prefetch requests are best effort: any failure is left for the regular
+ * fault path to handle.
+ */
+static void postcopy_prefetch_pages(MigrationIncomingState *mis,
+                                    PostcopyPrefetchStream *ps,
+                                    RAMBlock *rb, ram_addr_t offset)
+{
+    unsigned int npages = migrate_postcopy_prefetch_pages();
+    int64_t pagesize = qemu_ram_pagesize(rb);
+    int64_t delta = ps->rb == rb ? (int64_t)offset - ps->last_offset : 0;
+    int64_t next, last;
+    bool confirmed = false;
+    unsigned int sent = 0;
+
+    ps->rb = rb;
+    ps->last_offset = offset;
+
+    /*
+     * Once prefetching works the vCPU only faults again past the pages we
+     * asked for, so any fault a few strides ahead keeps the stream alive.
+     */
+    if (ps->stride && delta && delta % ps->stride == 0 &&
+        delta / ps->stride > 0 && delta / ps->stride <= npages + 1) {
+        confirmed = true;
+    } else {
+        ps->next_offset = -1;
+        if (delta && ABS(delta) <= POSTCOPY_PREFETCH_MAX_STRIDE * pagesize) {
+            ps->stride = delta;
+        } else {
+            ps->stride = 0;
+        }
+    }
+
+    if (!confirmed) {
+        return;
+    }
+
+    last = (int64_t)offset + (int64_t)npages * ps->stride;
+    next = offset + ps->stride;
+    /* Skip what was already requested by an earlier fault of this stream */
+    if (ps->next_offset >= 0 &&
+        (ps->stride > 0 ? ps->next_offset > next : ps->next_offset < next)) {
+        next = ps->next_offset;
+    }
+
+    for (; ps->stride > 0 ? next <= last : next >= last; next += ps->stride) {
+        if (next < 0 || next >= rb->postcopy_length) {
+            break;
+        }
+        if (ramblock_recv_bitmap_test_byte_offset(rb, next) ||
+            ramblock_page_is_discarded(rb, next)) {
+            continue;
+        }
+        if (migrate_send_rp_req_pages(mis, rb, next,
+                                      (uintptr_t)rb->host + next)) {
+            break;
+        }
+        sent++;
+    }
+    ps->next_offset = next;
+
+    trace_postcopy_prefetch_pages(qemu_ram_get_idstr(rb), offset,
+                                  ps->stride, sent);
+}
+
 static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
 {
     trace_postcopy_pause_fault_thread();
@@ -960,6 +1081,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
     int ret;
     size_t index;
     RAMBlock *rb = NULL;
+    PostcopyPrefetchStream *prefetch_streams = NULL;
 
     trace_postcopy_ram_fault_thread_entry();
     rcu_register_thread();
@@ -971,6 +1093,10 @@ static void *postcopy_ram_fault_thread(void *opaque)
 
     pfd = g_new0(struct pollfd, pfd_len);
 
+    if (migrate_postcopy_prefetch_pages()) {
+        prefetch_streams = postcopy_prefetch_streams_new();
+    }
+
     pfd[0].fd = mis->userfault_fd;
     pfd[0].events = POLLIN;
     pfd[1].fd = mis->userfault_event_fd;
@@ -1084,6 +1210,13 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+
+            if (prefetch_streams) {
+                postcopy_prefetch_pages(mis,
+                    postcopy_prefetch_stream_get(prefetch_streams,
+                                                 msg.arg.pagefault.feat.ptid),
+                    rb, rb_offset);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1144,6 +1277,7 @@ retry:
     }
     rcu_unregister_thread();
     trace_postcopy_ram_fault_thread_exit();
+    g_free(prefetch_streams);
     g_free(pfd);
     return NULL;
 }
@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
@@ -698,6 +699,57 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/**
+ * migration_bitmap_find_dirty: find the next dirty page in a ramblock
+ *
+ * Returns the index of the first dirty page in [@start, @size) of the
+ * ramblock dirty bitmap, or @size if there is none.  Chunks marked clean
+ * in the summary bitmap are skipped without looking at the dirty bitmap,
+ * and chunks found clean are marked as such.
+ *
+ * @rb: the ramblock to search in
+ * @start: page where we start the search
+ * @size: page where the search ends (exclusive)
+ */
+static unsigned long migration_bitmap_find_dirty(RAMBlock *rb,
+                                                 unsigned long start,
+                                                 unsigned long size)
+{
+    unsigned long chunk_pages = 1UL << BMAP_SUMMARY_SHIFT;
+    unsigned long nchunks = DIV_ROUND_UP(size, chunk_pages);
+
+    if (!rb->bmap_summary) {
+        return find_next_bit(rb->bmap, size, start);
+    }
+
+    while (start < size) {
+        unsigned long chunk = find_next_bit(rb->bmap_summary, nchunks,
+                                            start >> BMAP_SUMMARY_SHIFT);
+        unsigned long chunk_start = chunk << BMAP_SUMMARY_SHIFT;
+        unsigned long chunk_end = chunk_start + chunk_pages;
+        unsigned long end, page;
+
+        if (chunk >= nchunks) {
+            break;
+        }
+
+        start = MAX(start, chunk_start);
+        end = MIN(size, chunk_end);
+        page = find_next_bit(rb->bmap, end, start);
+        if (page < end) {
+            return page;
+        }
+
+        /* Only forget about the chunk if all of it was found clean */
+        if (start == chunk_start && end == chunk_end) {
+            clear_bit(chunk, rb->bmap_summary);
+        }
+        start = end;
+    }
+
+    return size;
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -713,7 +765,6 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
 {
     RAMBlock *rb = pss->block;
     unsigned long size = rb->used_length >> TARGET_PAGE_BITS;
-    unsigned long *bitmap = rb->bmap;
 
     if (migrate_ram_is_ignored(rb)) {
         /* Points directly to the end, so we know no dirty page */
@@ -730,7 +781,7 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
         size = MIN(size, pss->host_page_end);
     }
 
-    pss->page = find_next_bit(bitmap, size, pss->page);
+    pss->page = migration_bitmap_find_dirty(rb, pss->page, size);
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -984,8 +1035,10 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
 
 /*
  * Enable dirty-limit to throttle down the guest
+ *
+ * @budget: dirty page rate (MB/s) the migration can keep up with
  */
-static void migration_dirty_limit_guest(void)
+static void migration_dirty_limit_guest(uint64_t budget)
 {
     /*
      * dirty page rate quota for all vCPUs fetched from
@@ -993,17 +1046,29 @@ static void migration_dirty_limit_guest(void)
      */
     static int64_t quota_dirtyrate;
     MigrationState *s = migrate_get_current();
+    int64_t quota = s->parameters.vcpu_dirty_limit;
+
+    /*
+     * In adaptive mode the quota follows the per-vCPU dirty page rates so
+     * that only the heaviest writers are throttled, and only as much as
+     * needed for the total to fit in @budget.  vcpu-dirty-limit is the
+     * floor.  The per-vCPU rates are only known once the dirty limit
+     * service runs, so start it with a quota that only catches a single
+     * vCPU dirtying more than the whole budget.
+     */
+    if (migrate_dirty_limit_adaptive()) {
+        quota = MAX(quota, dirtylimit_in_service() ?
+                    dirtylimit_calc_fair_quota(budget) : budget);
+    }
 
     /*
-     * If dirty limit already enabled and migration parameter
-     * vcpu-dirty-limit untouched.
+     * If dirty limit already enabled and the quota is unchanged.
      */
-    if (dirtylimit_in_service() &&
-        quota_dirtyrate == s->parameters.vcpu_dirty_limit) {
+    if (dirtylimit_in_service() && quota_dirtyrate == quota) {
         return;
     }
 
-    quota_dirtyrate = s->parameters.vcpu_dirty_limit;
+    quota_dirtyrate = quota;
 
     /*
      * Set all vCPU a quota dirtyrate, note that the second
@@ -1013,7 +1078,7 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
-static void migration_trigger_throttle(RAMState *rs)
+static void migration_trigger_throttle(RAMState *rs, int64_t period_ms)
 {
     uint64_t threshold = migrate_throttle_trigger_threshold();
     uint64_t bytes_xfer_period =
@@ -1036,7 +1101,8 @@ static void migration_trigger_throttle(RAMState *rs)
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
         } else if (migrate_dirty_limit()) {
-            migration_dirty_limit_guest();
+            migration_dirty_limit_guest(bytes_dirty_threshold * 1000 /
+                                        period_ms / MiB);
         }
     }
 }
@@ -1071,7 +1137,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
-        migration_trigger_throttle(rs);
+        migration_trigger_throttle(rs, end_time - rs->time_last_bitmap_sync);
 
         migration_update_rates(rs, end_time);
 
@@ -2359,6 +2425,8 @@ static void ram_bitmaps_destroy(void)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->bmap_summary);
+        block->bmap_summary = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
     }
@@ -2562,6 +2630,7 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
                  */
                 rs->migration_dirty_pages += !test_and_set_bit(page, bitmap);
             }
+            bmap_summary_set(block, fixup_start_addr, host_ratio);
         }
 
         /* Find the next dirty page for the next iteration */
@@ -2747,6 +2816,9 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            block->bmap_summary = bitmap_new(clear_bmap_size(pages,
+                                                     BMAP_SUMMARY_SHIFT));
+            bmap_summary_set(block, 0, pages);
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
@@ -3459,6 +3531,7 @@ void colo_record_bitmap(RAMBlock *block, ram_addr_t *normal, uint32_t pages)
         ram_state->migration_dirty_pages += !test_and_set_bit(
                                                 offset >> TARGET_PAGE_BITS,
                                                 block->bmap);
+        bmap_summary_set(block, offset >> TARGET_PAGE_BITS, 1);
     }
     qemu_mutex_unlock(&ram_state->bitmap_mutex);
 }
@@ -4425,6 +4498,7 @@ bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *block, Error **errp)
      * dirty bitmap for this ramblock.
      */
     bitmap_complement(block->bmap, block->bmap, nbits);
+    bmap_summary_set(block, 0, nbits);
 
     /* Clear dirty bits of discarded ranges that we don't want to migrate. */
     ramblock_dirty_bitmap_clear_discarded_pages(block);
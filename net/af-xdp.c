@@ -43,6 +43,9 @@ typedef struct AFXDPState {
     bool                 read_poll;
     bool                 write_poll;
     uint32_t             outstanding_tx;
+    uint32_t             tx_batch;
+    bool                 tx_kick;
+    bool                 busy_poll;
 
     uint64_t             *pool;
     uint32_t             n_pool;
@@ -139,6 +142,20 @@ static void af_xdp_writable(void *opaque)
     qemu_flush_queued_packets(&s->nc);
 }
 
+/*
+ * Tell the kernel there is something on the Tx ring.  With busy polling
+ * the NAPI context is driven directly from here, otherwise the wakeup is
+ * done by polling the socket for writability.
+ */
+static void af_xdp_kick_tx(AFXDPState *s)
+{
+    if (s->busy_poll &&
+        sendto(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0) >= 0) {
+        return;
+    }
+    af_xdp_write_poll(s, true);
+}
+
 static ssize_t af_xdp_receive(NetClientState *nc,
                               const uint8_t *buf, size_t size)
 {
@@ -175,12 +192,33 @@ static ssize_t af_xdp_receive(NetClientState *nc,
     s->outstanding_tx++;
 
     if (xsk_ring_prod__needs_wakeup(&s->tx)) {
-        af_xdp_write_poll(s, true);
+        if (s->tx_batch) {
+            /* One wakeup for the whole batch, see af_xdp_receive_batch(). */
+            s->tx_kick = true;
+        } else {
+            af_xdp_kick_tx(s);
+        }
     }
 
     return size;
 }
 
+static void af_xdp_receive_batch(NetClientState *nc, bool begin)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    if (begin) {
+        s->tx_batch++;
+        return;
+    }
+
+    assert(s->tx_batch > 0);
+    if (!--s->tx_batch && s->tx_kick) {
+        s->tx_kick = false;
+        af_xdp_kick_tx(s);
+    }
+}
+
 /*
  * Complete a previous send (backend --> guest) and enable the
  * fd_read callback.
@@ -221,11 +259,17 @@ static void af_xdp_send(void *opaque)
     uint32_t i, n_rx, idx = 0;
     AFXDPState *s = opaque;
 
+    if (s->busy_poll) {
+        /* Let the kernel run the device NAPI loop on our behalf. */
+        recvfrom(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+
     n_rx = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
     if (!n_rx) {
         return;
     }
 
+    qemu_net_batch_begin(&s->nc);
     for (i = 0; i < n_rx; i++) {
         const struct xdp_desc *desc;
         struct iovec iov;
@@ -251,6 +295,7 @@ static void af_xdp_send(void *opaque)
             break;
         }
     }
+    qemu_net_batch_end(&s->nc);
 
     /* Release actually sent descriptors and try to re-fill. */
     xsk_ring_cons__release(&s->rx, n_rx);
@@ -396,11 +441,38 @@ static int af_xdp_socket_create(AFXDPState *s,
     return 0;
 }
 
+static int af_xdp_busy_poll_setup(AFXDPState *s, uint32_t usecs, Error **errp)
+{
+#ifdef SO_PREFER_BUSY_POLL
+    int fd = xsk_socket__fd(s->xsk);
+    int prefer = 1, timeout = usecs, budget = AF_XDP_BATCH_SIZE;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                   &prefer, sizeof(prefer))
+        || setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                      &timeout, sizeof(timeout))
+        || setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                      &budget, sizeof(budget))) {
+        error_setg_errno(errp, errno,
+                         "failed to enable busy polling for %s queue_index: %d",
+                         s->ifname, s->nc.queue_index);
+        return -1;
+    }
+
+    s->busy_poll = true;
+    return 0;
+#else
+    error_setg(errp, "busy polling of AF_XDP sockets is not supported");
+    return -1;
+#endif
+}
+
 /* NetClientInfo methods. */
 static NetClientInfo net_af_xdp_info = {
     .type = NET_CLIENT_DRIVER_AF_XDP,
     .size = sizeof(AFXDPState),
     .receive = af_xdp_receive,
+    .receive_batch = af_xdp_receive_batch,
     .poll = af_xdp_poll,
     .cleanup = af_xdp_cleanup,
 };
@@ -499,6 +571,16 @@ int net_init_af_xdp(const Netdev *netdev,
             error_propagate(errp, err);
             goto err;
         }
+
+        if (opts->has_busy_poll_us && opts->busy_poll_us
+            && af_xdp_busy_poll_setup(s, opts->busy_poll_us, errp)) {
+            /* This is the last queue with a socket to clean up. */
+            s->n_queues = i + 1;
+            goto err;
+        }
+
+        /* Initially only poll for reads, on every queue. */
+        af_xdp_read_poll(s, true);
     }
 
     if (nc0) {
@@ -511,8 +593,6 @@ int net_init_af_xdp(const Netdev *netdev,
         }
     }
 
-    af_xdp_read_poll(s, true); /* Initially only poll for reads. */
-
     return 0;
 
 err:
@@ -14,6 +14,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/error-report.h"
+#include "qemu/units.h"
 #include "trace.h"
 #include "qapi/error.h"
 #include "net/net.h"
@@ -46,6 +47,8 @@ static NotifierList colo_compare_notifiers =
 
 #define COMPARE_READ_LEN_MAX NET_BUFSIZE
 #define MAX_QUEUE_SIZE 1024
+/* Upper bound of a coalesced write to the outdev */
+#define COMPARE_SEND_BATCH_MAX (64 * KiB)
 
 #define COLO_COMPARE_FREE_PRIMARY     0x01
 #define COLO_COMPARE_FREE_SECONDARY   0x02
@@ -725,50 +728,40 @@ static void coroutine_fn _compare_chr_send(void *opaque)
 {
     SendCo *sendco = opaque;
     CompareState *s = sendco->s;
+    g_autoptr(GByteArray) batch = g_byte_array_new();
     int ret = 0;
 
     while (!g_queue_is_empty(&sendco->send_list)) {
-        SendEntry *entry = g_queue_pop_tail(&sendco->send_list);
-        uint32_t len = htonl(entry->size);
-
-        ret = qemu_chr_fe_write_all(sendco->chr, (uint8_t *)&len, sizeof(len));
-
-        if (ret != sizeof(len)) {
-            g_free(entry->buf);
-            g_slice_free(SendEntry, entry);
-            goto err;
-        }
-
-        if (!sendco->notify_remote_frame && s->vnet_hdr) {
-            /*
-             * We send vnet header len make other module(like filter-redirector)
-             * know how to parse net packet correctly.
-             */
-            len = htonl(entry->vnet_hdr_len);
-
-            ret = qemu_chr_fe_write_all(sendco->chr,
-                                        (uint8_t *)&len,
-                                        sizeof(len));
-
-            if (ret != sizeof(len)) {
-                g_free(entry->buf);
-                g_slice_free(SendEntry, entry);
-                goto err;
+        /*
+         * Frame the queued packets into one buffer, oldest first, so the
+         * chardev sees a single write per batch instead of up to three
+         * writes per packet.
+         */
+        g_byte_array_set_size(batch, 0);
+        do {
+            SendEntry *entry = g_queue_pop_head(&sendco->send_list);
+            uint32_t len = htonl(entry->size);
+
+            g_byte_array_append(batch, (guint8 *)&len, sizeof(len));
+            if (!sendco->notify_remote_frame && s->vnet_hdr) {
+                /*
+                 * We send vnet header len make other module(like
+                 * filter-redirector) know how to parse net packet correctly.
+                 */
+                len = htonl(entry->vnet_hdr_len);
+                g_byte_array_append(batch, (guint8 *)&len, sizeof(len));
             }
-        }
+            g_byte_array_append(batch, entry->buf, entry->size);
 
-        ret = qemu_chr_fe_write_all(sendco->chr,
-                                    (uint8_t *)entry->buf,
-                                    entry->size);
-
-        if (ret != entry->size) {
             g_free(entry->buf);
             g_slice_free(SendEntry, entry);
+        } while (!g_queue_is_empty(&sendco->send_list) &&
+                 batch->len < COMPARE_SEND_BATCH_MAX);
+
+        ret = qemu_chr_fe_write_all(sendco->chr, batch->data, batch->len);
+        if (ret != batch->len) {
             goto err;
         }
-
-        g_free(entry->buf);
-        g_slice_free(SendEntry, entry);
     }
 
     sendco->ret = 0;
@@ -55,42 +55,14 @@ static int _filter_send(MirrorState *s,
                        char *buf,
                        ssize_t size)
 {
-    NetFilterState *nf = NETFILTER(s);
-    int ret = 0;
-    uint32_t len = 0;
-
-    len = htonl(size);
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-    if (ret != sizeof(len)) {
-        goto err;
-    }
-
-    if (s->vnet_hdr) {
-        /*
-         * If vnet_hdr = on, we send vnet header len to make other
-         * module(like colo-compare) know how to parse net
-         * packet correctly.
-         */
-        ssize_t vnet_hdr_len;
-
-        vnet_hdr_len = nf->netdev->vnet_hdr_len;
-
-        len = htonl(vnet_hdr_len);
-        ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-        if (ret != sizeof(len)) {
-            goto err;
-        }
-    }
+    int ret;
 
     ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)buf, size);
     if (ret != size) {
-        goto err;
+        return ret < 0 ? ret : -EIO;
     }
 
     return size;
-
-err:
-    return ret < 0 ? ret : -EIO;
 }
 
 static void coroutine_fn filter_send_co(void *opaque)
@@ -107,19 +79,35 @@ static int filter_send(MirrorState *s,
                        const struct iovec *iov,
                        int iovcnt)
 {
+    NetFilterState *nf = NETFILTER(s);
     ssize_t size = iov_size(iov, iovcnt);
+    size_t hdr_len = sizeof(uint32_t);
     char *buf = NULL;
 
     if (!size) {
         return 0;
     }
 
-    buf = g_malloc(size);
-    iov_to_buf(iov, iovcnt, 0, buf, size);
+    /*
+     * If vnet_hdr = on, we send vnet header len to make other
+     * module(like colo-compare) know how to parse net
+     * packet correctly.
+     */
+    if (s->vnet_hdr) {
+        hdr_len += sizeof(uint32_t);
+    }
+
+    /* Frame the packet in a single buffer, so it takes one write */
+    buf = g_malloc(hdr_len + size);
+    stl_be_p(buf, size);
+    if (s->vnet_hdr) {
+        stl_be_p(buf + sizeof(uint32_t), nf->netdev->vnet_hdr_len);
+    }
+    iov_to_buf(iov, iovcnt, 0, buf + hdr_len, size);
 
     FilterSendCo data = {
         .s = s,
-        .size = size,
+        .size = hdr_len + size,
         .buf = buf,
         .ret = 0,
     };
@@ -131,7 +119,7 @@ static int filter_send(MirrorState *s,
         aio_poll(qemu_get_aio_context(), true);
     }
 
-    return data.ret;
+    return data.ret < 0 ? data.ret : size;
 }
 
 static void redirector_to_filter(NetFilterState *nf,
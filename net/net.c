@@ -672,8 +672,33 @@ void qemu_purge_queued_packets(NetClientState *nc)
     qemu_net_queue_purge(nc->peer->incoming_queue, nc);
 }
 
+static void qemu_net_receive_batch(NetClientState *nc, bool begin)
+{
+    if (nc && nc->info->receive_batch) {
+        nc->info->receive_batch(nc, begin);
+    }
+}
+
+/*
+ * Bracket a burst of packets sent by @nc.  Between the two calls the
+ * peer may defer per-packet completion work, such as publishing used
+ * buffers and raising interrupts, and do it once in qemu_net_batch_end().
+ * Calls may nest.
+ */
+void qemu_net_batch_begin(NetClientState *nc)
+{
+    qemu_net_receive_batch(nc->peer, true);
+}
+
+void qemu_net_batch_end(NetClientState *nc)
+{
+    qemu_net_receive_batch(nc->peer, false);
+}
+
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
 {
+    bool flushed;
+
     nc->receive_disabled = 0;
 
     if (nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_HUBPORT) {
@@ -681,7 +706,12 @@ void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
             qemu_notify_event();
         }
     }
-    if (qemu_net_queue_flush(nc->incoming_queue)) {
+
+    qemu_net_receive_batch(nc, true);
+    flushed = qemu_net_queue_flush(nc->incoming_queue);
+    qemu_net_receive_batch(nc, false);
+
+    if (flushed) {
         /* We emptied the queue successfully, signal to the IO thread to repoll
          * the file descriptor (for tap, for example).
          */
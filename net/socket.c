@@ -183,7 +183,10 @@ static void net_socket_send(void *opaque)
     }
     buf = buf1;
 
+    /* One read may carry several packets */
+    qemu_net_batch_begin(&s->nc);
     ret = net_fill_rstate(&s->rs, buf, size);
+    qemu_net_batch_end(&s->nc);
 
     if (ret == -1) {
         goto eoc;
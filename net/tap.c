@@ -162,6 +162,7 @@ static void tap_send(void *opaque)
     int size;
     int packets = 0;
 
+    qemu_net_batch_begin(&s->nc);
     while (true) {
         uint8_t *buf = s->buf;
         uint8_t min_pkt[ETH_ZLEN];
@@ -203,6 +204,7 @@ static void tap_send(void *opaque)
             break;
         }
     }
+    qemu_net_batch_end(&s->nc);
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -200,6 +200,13 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_trace *trace)
+{
+    plugin_register_vcpu_mem_trace(&insn->mem_cbs, rw, trace, insn->vaddr);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -597,6 +604,39 @@ void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     plugin_scoreboard_free(score);
 }
 
+struct qemu_plugin_mem_trace *
+qemu_plugin_mem_trace_new(size_t n_records,
+                          qemu_plugin_vcpu_mem_trace_cb_t cb,
+                          enum qemu_plugin_cb_flags flags,
+                          void *userdata)
+{
+    struct qemu_plugin_mem_trace *trace = g_new0(struct qemu_plugin_mem_trace,
+                                                 1);
+
+    g_assert(n_records > 0);
+    trace->score = plugin_scoreboard_new(
+        sizeof(struct qemu_plugin_mem_trace_buf) +
+        n_records * sizeof(qemu_plugin_mem_record));
+    trace->n_records = n_records;
+    trace->cb = cb;
+    trace->flags = flags;
+    trace->userdata = userdata;
+    plugin_mem_trace_add(trace);
+    return trace;
+}
+
+void qemu_plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace)
+{
+    plugin_mem_trace_free(trace);
+}
+
+void qemu_plugin_mem_trace_flush(struct qemu_plugin_mem_trace *trace,
+                                 unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < qemu_plugin_num_vcpus());
+    qemu_plugin_mem_trace_drain(vcpu_index, trace);
+}
+
 void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
                                   unsigned int vcpu_index)
 {
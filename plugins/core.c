@@ -465,6 +465,33 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->regular = regular_cb;
 }
 
+void plugin_register_vcpu_mem_trace(GArray **arr,
+                                    enum qemu_plugin_mem_rw rw,
+                                    struct qemu_plugin_mem_trace *trace,
+                                    uint64_t pc)
+{
+    static TCGHelperInfo info[3] = {
+        [QEMU_PLUGIN_CB_NO_REGS].flags = TCG_CALL_NO_RWG,
+        [QEMU_PLUGIN_CB_R_REGS].flags = TCG_CALL_NO_WG,
+        /*
+         * Match qemu_plugin_mem_trace_drain:
+         *   void (*)(uint32_t, void *)
+         */
+        [0 ... 2].typemask = (dh_typemask(void, 0) |
+                              dh_typemask(i32, 1) |
+                              dh_typemask(ptr, 2))
+    };
+    assert((unsigned)trace->flags < ARRAY_SIZE(info));
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_trace_cb trace_cb = { .trace = trace,
+                                             .info = &info[trace->flags],
+                                             .pc = pc,
+                                             .rw = rw };
+    dyn_cb->type = PLUGIN_CB_MEM_TRACE;
+    dyn_cb->trace = trace_cb;
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -601,6 +628,68 @@ void exec_inline_op(enum plugin_dyn_cb_type type,
     }
 }
 
+static struct qemu_plugin_mem_trace_buf *
+mem_trace_buf(struct qemu_plugin_mem_trace *trace, unsigned int vcpu_index)
+{
+    char *ptr = trace->score->data->data;
+    size_t elem_size = g_array_get_element_size(trace->score->data);
+
+    return (struct qemu_plugin_mem_trace_buf *)(ptr + vcpu_index * elem_size);
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void qemu_plugin_mem_trace_drain(unsigned int vcpu_index, void *udata)
+{
+    struct qemu_plugin_mem_trace *trace = udata;
+    struct qemu_plugin_mem_trace_buf *buf = mem_trace_buf(trace, vcpu_index);
+
+    if (buf->count) {
+        trace->cb(vcpu_index, buf->records, buf->count, trace->userdata);
+        buf->count = 0;
+    }
+}
+
+/*
+ * Deliver the records of every trace buffered for @cpu.  Generated code
+ * drains the traces it appended to before goto_tb and goto_ptr, this
+ * covers TBs that return to the execution loop instead.
+ */
+void qemu_plugin_tb_exit(CPUState *cpu)
+{
+    struct qemu_plugin_mem_trace *trace;
+
+    if (QLIST_EMPTY_RCU(&plugin.mem_traces)) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    QLIST_FOREACH_RCU(trace, &plugin.mem_traces, entry) {
+        qemu_plugin_mem_trace_drain(cpu->cpu_index, trace);
+    }
+}
+
+/* Append an access performed by a helper, as generated code would. */
+static void exec_mem_trace(struct qemu_plugin_trace_cb *cb,
+                           unsigned int vcpu_index,
+                           qemu_plugin_meminfo_t info, uint64_t vaddr)
+{
+    struct qemu_plugin_mem_trace_buf *buf = mem_trace_buf(cb->trace,
+                                                          vcpu_index);
+    qemu_plugin_mem_record *rec = &buf->records[buf->count];
+
+    rec->vaddr = vaddr;
+    rec->pc = cb->pc;
+    rec->info = info;
+    if (++buf->count == cb->trace->n_records) {
+        qemu_plugin_mem_trace_drain(vcpu_index, cb->trace);
+    }
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              uint64_t value_low,
                              uint64_t value_high,
@@ -634,6 +723,12 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                 exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
             }
             break;
+        case PLUGIN_CB_MEM_TRACE:
+            if (rw & cb->trace.rw) {
+                exec_mem_trace(&cb->trace, cpu->cpu_index,
+                               make_plugin_meminfo(oi, rw), vaddr);
+            }
+            break;
         default:
             g_assert_not_reached();
         }
@@ -733,6 +828,7 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.mem_traces);
     plugin.scoreboard_alloc_size = 16; /* avoid frequent reallocation */
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
@@ -768,3 +864,25 @@ void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     g_array_free(score->data, TRUE);
     g_free(score);
 }
+
+void plugin_mem_trace_add(struct qemu_plugin_mem_trace *trace)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_INSERT_HEAD_RCU(&plugin.mem_traces, trace, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
+static void plugin_mem_trace_free_rcu(struct qemu_plugin_mem_trace *trace)
+{
+    plugin_scoreboard_free(trace->score);
+    g_free(trace);
+}
+
+/* vCPUs leaving generated code may still be walking the list */
+void plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE_RCU(trace, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+    call_rcu(trace, plugin_mem_trace_free_rcu, rcu);
+}
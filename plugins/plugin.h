@@ -33,6 +33,8 @@ struct qemu_plugin_state {
     GHashTable *cpu_ht;
     QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
     size_t scoreboard_alloc_size;
+    /* RCU list, walked by vCPUs when they leave generated code */
+    QLIST_HEAD(, qemu_plugin_mem_trace) mem_traces;
     DECLARE_BITMAP(mask, QEMU_PLUGIN_EV_MAX);
     /*
      * @lock protects the struct as well as ctx->uninstalling.
@@ -108,6 +110,11 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+void plugin_register_vcpu_mem_trace(GArray **arr,
+                                    enum qemu_plugin_mem_rw rw,
+                                    struct qemu_plugin_mem_trace *trace,
+                                    uint64_t pc);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index);
@@ -118,4 +125,8 @@ struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
 
 void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
+void plugin_mem_trace_add(struct qemu_plugin_mem_trace *trace);
+
+void plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace);
+
 #endif /* PLUGIN_H */
@@ -186,6 +186,8 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
+    "                tb-exec-count=on|off (count TCG translation block executions)\n"
+    "                tb-lookup-stats=on|off (count how TCG translation block lookups are resolved)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
@@ -227,6 +229,19 @@ SRST
         such a case this will default on. On other operating systems, this
         will default off, but one may enable this for testing or debugging.
 
+    ``tb-exec-count=on|off``
+        Makes the TCG accelerator emit a counter increment at the start
+        of each translation block. ``info jit`` then lists the most
+        frequently executed blocks. Only blocks translated while the
+        option is on are counted. The default is off.
+
+    ``tb-lookup-stats=on|off``
+        Makes the TCG accelerator count how translation block lookups
+        and indirect jumps are resolved: in the per-CPU jump cache, in
+        the global hash table, or by leaving the generated code.
+        ``info jit`` then reports the hit rates. This is a profiling aid
+        and adds a little overhead to every lookup. The default is off.
+
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
@@ -2863,6 +2878,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
 #ifdef CONFIG_AF_XDP
     "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
     "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
+    "         [,busy-poll-us=t]\n"
     "                attach to the existing network interface 'name' with AF_XDP socket\n"
     "                use 'mode=MODE' to specify an XDP program attach mode\n"
     "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
@@ -2872,6 +2888,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                  added to a socket map in XDP program.  One socket per queue.\n"
     "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
     "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-poll-us=t' to busy poll the sockets for up to t microseconds\n"
 #endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
@@ -3564,7 +3581,7 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
-``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]``
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,busy-poll-us=t]``
     Configure AF_XDP backend to connect to a network interface 'name'
     using AF_XDP socket.  A specific program attach mode for a default
     XDP program can be forced with 'mode', defaults to best-effort,
@@ -3613,6 +3630,18 @@ SRST
         |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
             -netdev af-xdp,id=n1,ifname=eth0,queues=3,inhibit=on,sock-fds=15:16:17
 
+    'busy-poll-us' enables preferred busy polling on every socket with the
+    given timeout.  QEMU then drives the device NAPI processing itself
+    when it services a queue, instead of waiting for an interrupt.  For it
+    to be effective, interrupts of the device should be deferred, e.g.:
+
+    .. parsed-literal::
+
+        echo 2 > /sys/class/net/eth0/napi_defer_hard_irqs
+        echo 200000 > /sys/class/net/eth0/gro_flush_timeout
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1,mq=on \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=4,busy-poll-us=20
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -156,6 +156,7 @@ static StatsFilter *stats_filter(StatsTarget target, const char *names,
         break;
     }
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_VIRTIO:
         break;
     default:
         break;
@@ -229,6 +230,7 @@ void hmp_info_stats(Monitor *mon, const QDict *qdict)
         filter = stats_filter(target, names, cpu_index, provider);
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_VIRTIO:
         filter = stats_filter(target, names, -1, provider);
         break;
     default:
@@ -607,6 +607,63 @@ uint64_t dirtylimit_ring_full_time(void)
     return dirtylimit_dirty_ring_full_time(curr_rate / nvcpus);
 }
 
+static int dirtylimit_rate_cmp(const void *a, const void *b)
+{
+    uint64_t ra = *(const uint64_t *)a, rb = *(const uint64_t *)b;
+
+    return ra < rb ? -1 : ra > rb;
+}
+
+/*
+ * Return the dirty page rate quota (MB/s) that, applied to every virtual
+ * CPU, keeps the sum of the current dirty page rates within @budget MB/s.
+ *
+ * The budget is shared max-min fairly: virtual CPUs dirtying less than an
+ * equal share of what is left keep their current rate, which is returned
+ * to the pool for the heavier writers.  Only the virtual CPUs dirtying
+ * more than the returned quota are therefore throttled.  @budget is
+ * returned as is if the dirty limit service is not running.
+ */
+uint64_t dirtylimit_calc_fair_quota(uint64_t budget)
+{
+    CPUState *cpu;
+    g_autofree uint64_t *rates = NULL;
+    uint64_t quota = budget;
+    int nvcpus = 0, i;
+
+    dirtylimit_state_lock();
+
+    if (!dirtylimit_in_service()) {
+        dirtylimit_state_unlock();
+        return budget;
+    }
+
+    rates = g_new0(uint64_t, dirtylimit_state->max_cpus);
+    CPU_FOREACH(cpu) {
+        rates[nvcpus++] = vcpu_dirty_rate_get(cpu->cpu_index);
+    }
+
+    dirtylimit_state_unlock();
+
+    qsort(rates, nvcpus, sizeof(*rates), dirtylimit_rate_cmp);
+
+    for (i = 0; i < nvcpus; i++) {
+        quota = budget / (nvcpus - i);
+        if (rates[i] > quota) {
+            break;
+        }
+        budget -= rates[i];
+    }
+
+    /* Everybody fits, leave the heaviest writer some headroom */
+    if (i == nvcpus && nvcpus) {
+        quota = rates[nvcpus - 1] + budget;
+    }
+
+    trace_dirtylimit_calc_fair_quota(quota, nvcpus - i);
+    return quota;
+}
+
 static struct DirtyLimitInfo *dirtylimit_query_vcpu(int cpu_index)
 {
     DirtyLimitInfo *info = NULL;
@@ -58,6 +58,12 @@ typedef struct TempOptInfo {
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
+    /*
+     * TCG_MO_* orderings that may need enforcing: for TCG_MO_A_B, an
+     * access of type A has been seen since the last barrier that
+     * ordered A before B.
+     */
+    TCGBar mo_pending;
     TCGTempSet temps_used;
 
     IntervalTreeRoot mem_copy;
@@ -976,6 +982,7 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     if (def->flags & TCG_OPF_BB_END) {
         ctx->prev_mb = NULL;
         if (!(def->flags & TCG_OPF_COND_BRANCH)) {
+            ctx->mo_pending = TCG_MO_ALL;
             memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
             remove_mem_copy_all(ctx);
         }
@@ -1535,8 +1542,9 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
         reset_temp(ctx, op->args[i]);
     }
 
-    /* Stop optimizing MB across calls. */
+    /* Stop optimizing MB across calls; the helper may access memory. */
     ctx->prev_mb = NULL;
+    ctx->mo_pending = TCG_MO_ALL;
     return true;
 }
 
@@ -1820,6 +1828,22 @@ static bool fold_extu(OptContext *ctx, TCGOp *op)
 
 static bool fold_mb(OptContext *ctx, TCGOp *op)
 {
+    /*
+     * Drop the orderings that no access since the previous barrier
+     * providing them can violate.  E.g. for a strongly ordered guest
+     *   st; mb ld_st|st_st; st => st; mb st_st; st
+     *   st; mb ld_ld; ld => st; ld
+     * This lets the backend use a weaker fence, or none at all.
+     */
+    TCGBar mo = op->args[0] & ctx->mo_pending;
+
+    op->args[0] = (op->args[0] & ~TCG_MO_ALL) | mo;
+    ctx->mo_pending &= ~mo;
+    if (!mo) {
+        tcg_op_remove(ctx->tcg, op);
+        return true;
+    }
+
     /* Eliminate duplicate and redundant fence instructions.  */
     if (ctx->prev_mb) {
         /*
@@ -2085,6 +2109,7 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    ctx->mo_pending |= TCG_MO_LD_LD | TCG_MO_LD_ST;
     return false;
 }
 
@@ -2092,6 +2117,7 @@ static bool fold_qemu_st(OptContext *ctx, TCGOp *op)
 {
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    ctx->mo_pending |= TCG_MO_ST_LD | TCG_MO_ST_ST;
     return false;
 }
 
@@ -2797,7 +2823,7 @@ void tcg_optimize(TCGContext *s)
 {
     int nb_temps, i;
     TCGOp *op, *op_next;
-    OptContext ctx = { .tcg = s };
+    OptContext ctx = { .tcg = s, .mo_pending = TCG_MO_ALL };
 
     QSIMPLEQ_INIT(&ctx.mem_free);
 
@@ -27,6 +27,7 @@
 #include "qemu/madvise.h"
 #include "qemu/mprotect.h"
 #include "qemu/memalign.h"
+#include "qemu/bitmap.h"
 #include "qemu/cacheinfo.h"
 #include "qemu/qtree.h"
 #include "qapi/error.h"
@@ -72,6 +73,9 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    uint64_t alloc_seq; /* number of region assignments so far */
+    uint64_t *seq; /* value of alloc_seq when each region was assigned */
+    unsigned long *evicted; /* regions emptied by tcg_region_evict() */
 };
 
 static struct tcg_region_state region;
@@ -191,10 +195,22 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    if (p < region.start_aligned) {
+        return 0;
+    } else {
+        ptrdiff_t offset = p - region.start_aligned;
+
+        if (offset > region.stride * (region.n - 1)) {
+            return region.n - 1;
+        }
+        return offset / region.stride;
+    }
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -206,18 +222,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
         }
     }
 
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -359,11 +364,19 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t curr_region;
+
+    if (region.current < region.n) {
+        curr_region = region.current++;
+    } else {
+        curr_region = find_first_bit(region.evicted, region.n);
+        if (curr_region == region.n) {
+            return true;
+        }
+        clear_bit(curr_region, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, curr_region);
+    region.seq[curr_region] = region.alloc_seq++;
     return false;
 }
 
@@ -412,6 +425,8 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.alloc_seq = 0;
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,6 +437,76 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Pick the least recently assigned region that is neither in use by a
+ * TCGContext nor already free.
+ * Returns region.n if there is no such region.
+ */
+static size_t tcg_region_find_victim__locked(void)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autofree unsigned long *busy = bitmap_new(region.n);
+    size_t victim = region.n;
+    unsigned int i;
+    size_t r;
+
+    bitmap_copy(busy, region.evicted, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+        set_bit(tcg_region_index(s->code_gen_buffer), busy);
+    }
+
+    for (r = 0; r < region.current; r++) {
+        if (!test_bit(r, busy) &&
+            (victim == region.n || region.seq[r] < region.seq[victim])) {
+            victim = r;
+        }
+    }
+    return victim;
+}
+
+/*
+ * Call from a safe-work context.
+ * Make room in the code buffer without a full flush, by emptying the
+ * region that was filled longest ago.  @func is called on each TB of
+ * that region, and must unlink the TB from every other structure that
+ * references it before the region's code is overwritten.
+ * Returns false if no region can be evicted, in which case the caller
+ * should fall back to a full flush.
+ */
+bool tcg_region_evict(GTraverseFunc func, gpointer user_data)
+{
+    struct tcg_region_tree *rt;
+    void *start, *end;
+    size_t victim;
+
+    qemu_mutex_lock(&region.lock);
+    if (!bitmap_empty(region.evicted, region.n)) {
+        /* Somebody else already made room for us */
+        qemu_mutex_unlock(&region.lock);
+        return true;
+    }
+    victim = tcg_region_find_victim__locked();
+    if (victim == region.n) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+
+    rt = region_trees + victim * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    q_tree_foreach(rt->tree, func, user_data);
+    /* Increment the refcount first so that destroy acts as a reset */
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(victim, &start, &end);
+    region.agg_size_full -= (end - start) - TCG_HIGHWATER;
+    set_bit(victim, region.evicted);
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -808,6 +893,8 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.seq = g_new0(uint64_t, region.n);
+    region.evicted = bitmap_new(region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
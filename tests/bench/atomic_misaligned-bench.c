@@ -0,0 +1,329 @@
+/*
+ * Misaligned atomic increment benchmark
+ *
+ * Compare the two ways TCG can emulate a guest atomic whose address is
+ * not naturally aligned: a compare-and-swap loop on the aligned host
+ * word that contains it, or stopping every other thread around the
+ * operation, as cpu_exec_step_atomic() does.  The former runs the same
+ * atomic_cmpxchg_widened() as the TCG atomic helpers.  The latter uses a
+ * copy of the start_exclusive()/end_exclusive() protocol of cpu-common.c,
+ * with each thread standing for a vCPU.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/lockable.h"
+#include "qemu/host-utils.h"
+#include "qemu/processor.h"
+#include "qemu/memalign.h"
+#include "qemu/atomic-widened.h"
+
+struct thread_info {
+    uint64_t r;
+    uint64_t ops;
+    /* cpu->running and cpu->has_waiter */
+    bool running;
+    bool has_waiter;
+} QEMU_ALIGNED(64);
+
+/* A 32-bit counter at offset 2 of an aligned 16-byte block */
+struct count {
+    uint8_t bytes[16];
+} QEMU_ALIGNED(64);
+
+#define COUNT_OFFSET 2
+
+static QemuThread *threads;
+static struct thread_info *th_info;
+static unsigned int n_threads = 1;
+static unsigned int n_ready_threads;
+static struct count *counts;
+static unsigned int duration = 1;
+static unsigned int range = 1024;
+static bool use_exclusive;
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -n = number of threads\n"
+    " -m = stop all threads around each increment instead of widening it\n"
+    " -d = duration in seconds\n"
+    " -r = range (will be rounded up to pow2)";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static uint32_t count_get(struct count *c)
+{
+    uint32_t val;
+
+    memcpy(&val, c->bytes + COUNT_OFFSET, sizeof(val));
+    return val;
+}
+
+static void count_set(struct count *c, uint32_t val)
+{
+    memcpy(c->bytes + COUNT_OFFSET, &val, sizeof(val));
+}
+
+/* As ATOMIC_RMW_LOOP in accel/tcg/atomic_template.h */
+static void count_inc_widened(struct count *c)
+{
+    uint32_t *p = (uint32_t *)(c->bytes + COUNT_OFFSET);
+    uint32_t old, new, cur, zero = 0;
+
+    atomic_cmpxchg_widened(p, &zero, &zero, &cur, sizeof(cur));
+    do {
+        old = cur;
+        new = old + 1;
+        atomic_cmpxchg_widened(p, &old, &new, &cur, sizeof(cur));
+    } while (cur != old);
+}
+
+/*
+ * Exclusive sections, as in cpu-common.c.  Threads do not block anywhere
+ * else, so there is nothing to kick.
+ */
+static QemuMutex list_lock;
+static QemuCond exclusive_cond;
+static QemuCond exclusive_resume;
+static int pending_threads;
+
+static void exclusive_idle(void)
+{
+    while (pending_threads) {
+        qemu_cond_wait(&exclusive_resume, &list_lock);
+    }
+}
+
+static void start_exclusive(struct thread_info *self)
+{
+    int running_threads = 0;
+    unsigned int i;
+
+    qemu_mutex_lock(&list_lock);
+    exclusive_idle();
+
+    qatomic_set(&pending_threads, 1);
+    smp_mb();
+    for (i = 0; i < n_threads; i++) {
+        struct thread_info *other = &th_info[i];
+
+        if (other != self && qatomic_read(&other->running)) {
+            other->has_waiter = true;
+            running_threads++;
+        }
+    }
+
+    qatomic_set(&pending_threads, running_threads + 1);
+    while (pending_threads > 1) {
+        qemu_cond_wait(&exclusive_cond, &list_lock);
+    }
+    qemu_mutex_unlock(&list_lock);
+}
+
+static void end_exclusive(void)
+{
+    qemu_mutex_lock(&list_lock);
+    qatomic_set(&pending_threads, 0);
+    qemu_cond_broadcast(&exclusive_resume);
+    qemu_mutex_unlock(&list_lock);
+}
+
+static void exec_start(struct thread_info *info)
+{
+    qatomic_set(&info->running, true);
+    smp_mb();
+    if (unlikely(qatomic_read(&pending_threads))) {
+        QEMU_LOCK_GUARD(&list_lock);
+        if (!info->has_waiter) {
+            qatomic_set(&info->running, false);
+            exclusive_idle();
+            qatomic_set(&info->running, true);
+        }
+    }
+}
+
+static void exec_end(struct thread_info *info)
+{
+    qatomic_set(&info->running, false);
+    smp_mb();
+    if (unlikely(qatomic_read(&pending_threads))) {
+        QEMU_LOCK_GUARD(&list_lock);
+        if (info->has_waiter) {
+            info->has_waiter = false;
+            qatomic_set(&pending_threads, pending_threads - 1);
+            if (pending_threads == 1) {
+                qemu_cond_signal(&exclusive_cond);
+            }
+        }
+    }
+}
+
+/* Leave the execution loop and run the increment alone */
+static void count_inc_exclusive(struct thread_info *info, struct count *c)
+{
+    exec_end(info);
+    start_exclusive(info);
+    count_set(c, count_get(c) + 1);
+    end_exclusive();
+    exec_start(info);
+}
+
+static void *thread_func(void *arg)
+{
+    struct thread_info *info = arg;
+
+    exec_start(info);
+    qatomic_inc(&n_ready_threads);
+    while (!qatomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    while (!qatomic_read(&test_stop)) {
+        unsigned int index;
+
+        info->r = xorshift64star(info->r);
+        index = info->r & (range - 1);
+        if (use_exclusive) {
+            count_inc_exclusive(info, &counts[index]);
+        } else {
+            count_inc_widened(&counts[index]);
+        }
+        info->ops++;
+    }
+    exec_end(info);
+    return NULL;
+}
+
+static void run_test(void)
+{
+    unsigned int i;
+
+    while (qatomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+
+    qatomic_set(&test_start, true);
+    g_usleep(duration * G_USEC_PER_SEC);
+    qatomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void create_threads(void)
+{
+    unsigned int i;
+
+    threads = g_new(QemuThread, n_threads);
+    th_info = g_new(struct thread_info, n_threads);
+    counts = qemu_memalign(64, sizeof(*counts) * range);
+    memset(counts, 0, sizeof(*counts) * range);
+    qemu_mutex_init(&list_lock);
+    qemu_cond_init(&exclusive_cond);
+    qemu_cond_init(&exclusive_resume);
+
+    for (i = 0; i < n_threads; i++) {
+        struct thread_info *info = &th_info[i];
+
+        info->r = (i + 1) ^ time(NULL);
+        info->ops = 0;
+        info->running = false;
+        info->has_waiter = false;
+        qemu_thread_create(&threads[i], NULL, thread_func, info,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" duration:          %u\n", duration);
+    printf(" ops' range:        %u\n", range);
+    printf(" mode:              %s\n", use_exclusive ? "exclusive" : "widened");
+}
+
+static void pr_stats(void)
+{
+    unsigned long long val = 0, ops = 0;
+    unsigned int i;
+    double tx;
+
+    for (i = 0; i < range; i++) {
+        val += count_get(&counts[i]);
+    }
+    for (i = 0; i < n_threads; i++) {
+        ops += th_info[i].ops;
+    }
+    /* The counters wrap, but no increment may be lost */
+    g_assert((uint32_t)val == (uint32_t)ops);
+    tx = ops / duration / 1e6;
+
+    printf("Results:\n");
+    printf("Duration:            %u s\n", duration);
+    printf(" Throughput:         %.2f Mops/s\n", tx);
+    printf(" Throughput/thread:  %.2f Mops/s/thread\n", tx / n_threads);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hd:n:mr:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'm':
+            use_exclusive = true;
+            break;
+        case 'r':
+            range = pow2ceil(atoi(optarg));
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    if (!use_exclusive && !atomic_widened_ok(COUNT_OFFSET, sizeof(uint32_t))) {
+        fprintf(stderr, "This host cannot widen the increment, use -m\n");
+        return 1;
+    }
+    pr_params();
+    create_threads();
+    run_test();
+    pr_stats();
+    return 0;
+}
@@ -2944,6 +2944,15 @@ test_migrate_precopy_tcp_multifd_zlib_start(QTestState *from,
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "zlib");
 }
 
+static void *
+test_migrate_precopy_tcp_multifd_xbzrle_start(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "xbzrle");
+}
+
 #ifdef CONFIG_ZSTD
 static void *
 test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
@@ -3054,6 +3063,20 @@ static void test_multifd_tcp_zlib(void)
     test_precopy_common(&args);
 }
 
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_xbzrle_start,
+        /*
+         * Multiple iterations are needed for pages to be sent as deltas
+         * against the cache.
+         */
+        .iterations = 2,
+    };
+    test_precopy_common(&args);
+}
+
 #ifdef CONFIG_ZSTD
 static void test_multifd_tcp_zstd(void)
 {
@@ -3990,6 +4013,8 @@ int main(int argc, char **argv)
                        test_multifd_tcp_cancel);
     migration_test_add("/migration/multifd/tcp/plain/zlib",
                        test_multifd_tcp_zlib);
+    migration_test_add("/migration/multifd/tcp/plain/xbzrle",
+                       test_multifd_tcp_xbzrle);
 #ifdef CONFIG_ZSTD
     migration_test_add("/migration/multifd/tcp/plain/zstd",
                        test_multifd_tcp_zstd);
@@ -12,6 +12,8 @@
 #include "libqtest-single.h"
 #include "qemu/bswap.h"
 #include "qemu/module.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "standard-headers/linux/virtio_blk.h"
 #include "standard-headers/linux/virtio_pci.h"
 #include "libqos/qgraph.h"
@@ -20,6 +22,7 @@
 #define TEST_IMAGE_SIZE         (64 * 1024 * 1024)
 #define QVIRTIO_BLK_TIMEOUT_US  (30 * 1000 * 1000)
 #define PCI_SLOT_HP             0x06
+#define COALESCE_USECS          (1000 * 1000)
 
 typedef struct QVirtioBlkReq {
     uint32_t type;
@@ -771,6 +774,162 @@ static void resize(void *obj, void *data, QGuestAllocator *t_alloc)
 
 }
 
+/* Sum one counter over all devices reported by query-stats */
+static int64_t virtio_stats_get(QTestState *qts, const char *name)
+{
+    QDict *resp;
+    QListEntry *entry, *stat_entry;
+    int64_t sum = 0;
+
+    resp = qtest_qmp(qts, "{ 'execute': 'query-stats',"
+                     "  'arguments': { 'target': 'virtio',"
+                     "                 'providers': [ { 'provider': 'virtio',"
+                     "                                  'names': [ %s ] } ] } }",
+                     name);
+    g_assert(qdict_haskey(resp, "return"));
+
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(resp, "return"), entry) {
+        QDict *result = qobject_to(QDict, qlist_entry_obj(entry));
+
+        QLIST_FOREACH_ENTRY(qdict_get_qlist(result, "stats"), stat_entry) {
+            QDict *stat = qobject_to(QDict, qlist_entry_obj(stat_entry));
+
+            g_assert_cmpstr(qdict_get_str(stat, "name"), ==, name);
+            sum += qdict_get_int(stat, "value");
+        }
+    }
+
+    qobject_unref(resp);
+    return sum;
+}
+
+static void coalesce(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint64_t features;
+    uint32_t free_head;
+    uint8_t status;
+    QTestState *qts = global_qtest;
+    QVirtQueue *vq;
+
+    /* Without event-idx every completion asks for an interrupt */
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                    (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                    (1u << VIRTIO_RING_F_EVENT_IDX) |
+                    (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+
+    qvirtio_set_driver_ok(dev);
+
+    req.type = VIRTIO_BLK_T_OUT;
+    req.ioprio = 1;
+    req.sector = 0;
+    req.data = g_malloc0(512);
+    strcpy(req.data, "TEST");
+
+    req_addr = virtio_blk_request(t_alloc, dev, &req, 512);
+
+    g_free(req.data);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    /* The request completes, but its interrupt is held back... */
+    status = qvirtio_wait_status_byte_no_isr(qts, dev, vq, req_addr + 528,
+                                             QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(status, ==, 0);
+    g_assert_cmpint(virtio_stats_get(qts, "completions"), ==, 1);
+    g_assert_cmpint(virtio_stats_get(qts, "interrupts"), ==, 0);
+
+    /* ...until coalesce-usecs have passed */
+    qtest_clock_step(qts, COALESCE_USECS * 1000LL);
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(virtio_stats_get(qts, "interrupts"), ==, 1);
+
+    guest_free(t_alloc, req_addr);
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
+/*
+ * With event-idx the guest does not ask for another interrupt while the
+ * first one is held back, but max-frames must still cut the wait short.
+ */
+static void coalesce_max_frames(void *obj, void *data,
+                                QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    QVirtioBlkReq req;
+    uint64_t req_addr[2];
+    uint64_t features;
+    uint32_t free_head[2];
+    uint32_t desc_idx;
+    uint8_t status;
+    QTestState *qts = global_qtest;
+    QVirtQueue *vq;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    g_assert(features & (1u << VIRTIO_RING_F_EVENT_IDX));
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                    (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                    (1u << VIRTIO_F_NOTIFY_ON_EMPTY) |
+                    (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < 2; i++) {
+        req.type = VIRTIO_BLK_T_OUT;
+        req.ioprio = 1;
+        req.sector = i;
+        req.data = g_malloc0(512);
+        strcpy(req.data, "TEST");
+
+        req_addr[i] = virtio_blk_request(t_alloc, dev, &req, 512);
+
+        g_free(req.data);
+
+        free_head[i] = qvirtqueue_add(qts, vq, req_addr[i], 16, false, true);
+        qvirtqueue_add(qts, vq, req_addr[i] + 16, 512, false, true);
+        qvirtqueue_add(qts, vq, req_addr[i] + 528, 1, true, false);
+        qvirtqueue_kick(qts, dev, vq, free_head[i]);
+
+        if (i == 0) {
+            /* The first completion's interrupt is held back... */
+            status = qvirtio_wait_status_byte_no_isr(qts, dev, vq,
+                                                     req_addr[i] + 528,
+                                                     QVIRTIO_BLK_TIMEOUT_US);
+            g_assert_cmpint(status, ==, 0);
+            g_assert_cmpint(virtio_stats_get(qts, "interrupts"), ==, 0);
+            g_assert(qvirtqueue_get_buf(qts, vq, &desc_idx, NULL));
+            g_assert_cmpint(desc_idx, ==, free_head[0]);
+        }
+    }
+
+    /* ...and the second one sends it, long before coalesce-usecs */
+    qvirtio_wait_used_elem(qts, dev, vq, free_head[1], NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(virtio_stats_get(qts, "completions"), ==, 2);
+    g_assert_cmpint(virtio_stats_get(qts, "interrupts"), ==, 1);
+
+    for (i = 0; i < 2; i++) {
+        guest_free(t_alloc, req_addr[i]);
+    }
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
 static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
 {
     char *tmp_path = drive_create();
@@ -785,16 +944,43 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_blk_coalesce_test_setup(GString *cmd_line, void *arg)
+{
+    g_string_append_printf(cmd_line,
+                           " -global virtio-blk-device.coalesce-usecs=%d ",
+                           COALESCE_USECS);
+
+    return virtio_blk_test_setup(cmd_line, arg);
+}
+
+static void *virtio_blk_coalesce_max_frames_test_setup(GString *cmd_line,
+                                                       void *arg)
+{
+    g_string_append(cmd_line,
+                    " -global virtio-blk-device.coalesce-max-frames=2 ");
+
+    return virtio_blk_coalesce_test_setup(cmd_line, arg);
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
         .before = virtio_blk_test_setup,
     };
+    QOSGraphTestOptions coalesce_opts = {
+        .before = virtio_blk_coalesce_test_setup,
+    };
+    QOSGraphTestOptions coalesce_max_frames_opts = {
+        .before = virtio_blk_coalesce_max_frames_test_setup,
+    };
 
     qos_add_test("indirect", "virtio-blk", indirect, &opts);
     qos_add_test("config", "virtio-blk", config, &opts);
     qos_add_test("basic", "virtio-blk", basic, &opts);
     qos_add_test("resize", "virtio-blk", resize, &opts);
+    qos_add_test("coalesce", "virtio-blk", coalesce, &coalesce_opts);
+    qos_add_test("coalesce-max-frames", "virtio-blk", coalesce_max_frames,
+                 &coalesce_max_frames_opts);
 
     /* tests just for virtio-blk-pci */
     qos_add_test("msix", "virtio-blk-pci", msix, &opts);
@@ -0,0 +1,158 @@
+/*
+ * Memory ordering litmus tests
+ *
+ * Run the classic message passing, store buffering and load buffering
+ * shapes between two threads and check that no outcome forbidden by
+ * the C11 memory model is ever observed.  With a strongly ordered
+ * guest on a weakly ordered host this exercises the barriers that TCG
+ * emits around guest accesses, including after the optimizer has
+ * merged or weakened them.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 20000
+
+typedef struct {
+    const char *name;
+    void (*t0)(void);
+    void (*t1)(void);
+    bool (*forbidden)(void);
+} Litmus;
+
+static atomic_int x, y;
+static int r0, r1;
+
+static atomic_uint arrived;
+static atomic_uint generation;
+
+/* Sense-reversing barrier for the two test threads */
+static void sync_threads(void)
+{
+    unsigned gen = atomic_load(&generation);
+
+    if (atomic_fetch_add(&arrived, 1) == 1) {
+        atomic_store(&arrived, 0);
+        atomic_store(&generation, gen + 1);
+    } else {
+        while (atomic_load(&generation) == gen) {
+            sched_yield();
+        }
+    }
+}
+
+/* MP: the reader must see the data once it sees the flag */
+static void mp_t0(void)
+{
+    atomic_store_explicit(&x, 1, memory_order_relaxed);
+    atomic_store_explicit(&y, 1, memory_order_release);
+}
+
+static void mp_t1(void)
+{
+    r0 = atomic_load_explicit(&y, memory_order_acquire);
+    r1 = atomic_load_explicit(&x, memory_order_relaxed);
+}
+
+static bool mp_forbidden(void)
+{
+    return r0 == 1 && r1 == 0;
+}
+
+/* SB: with sequential consistency, one store must be seen */
+static void sb_t0(void)
+{
+    atomic_store(&x, 1);
+    r0 = atomic_load(&y);
+}
+
+static void sb_t1(void)
+{
+    atomic_store(&y, 1);
+    r1 = atomic_load(&x);
+}
+
+static bool sb_forbidden(void)
+{
+    return r0 == 0 && r1 == 0;
+}
+
+/* LB: a load must not observe a store that follows the other load */
+static void lb_t0(void)
+{
+    r0 = atomic_load_explicit(&x, memory_order_acquire);
+    atomic_store_explicit(&y, 1, memory_order_release);
+}
+
+static void lb_t1(void)
+{
+    r1 = atomic_load_explicit(&y, memory_order_acquire);
+    atomic_store_explicit(&x, 1, memory_order_release);
+}
+
+static bool lb_forbidden(void)
+{
+    return r0 == 1 && r1 == 1;
+}
+
+static const Litmus tests[] = {
+    { "MP", mp_t0, mp_t1, mp_forbidden },
+    { "SB", sb_t0, sb_t1, sb_forbidden },
+    { "LB", lb_t0, lb_t1, lb_forbidden },
+};
+
+static void *thread1_fn(void *arg)
+{
+    const Litmus *t = arg;
+
+    for (int i = 0; i < ROUNDS; i++) {
+        sync_threads();
+        t->t1();
+        sync_threads();
+    }
+    return NULL;
+}
+
+static int run_test(const Litmus *t)
+{
+    pthread_t thread1;
+    int bad = 0;
+
+    if (pthread_create(&thread1, NULL, thread1_fn, (void *)t)) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < ROUNDS; i++) {
+        atomic_store(&x, 0);
+        atomic_store(&y, 0);
+        r0 = r1 = -1;
+        sync_threads();
+        t->t0();
+        sync_threads();
+        if (t->forbidden()) {
+            bad++;
+        }
+    }
+
+    pthread_join(thread1, NULL);
+    printf("%s: %d/%d forbidden outcomes\n", t->name, bad, ROUNDS);
+    return bad;
+}
+
+int main(void)
+{
+    int bad = 0;
+
+    for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        bad += run_test(&tests[i]);
+    }
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -59,7 +59,9 @@ typedef struct {
 static struct qemu_plugin_scoreboard *counts;
 static qemu_plugin_u64 mem_count;
 static qemu_plugin_u64 io_count;
-static bool do_inline, do_callback, do_print_accesses, do_region_summary;
+static struct qemu_plugin_mem_trace *trace;
+static bool do_inline, do_callback, do_trace;
+static bool do_print_accesses, do_region_summary;
 static bool do_haddr;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 
@@ -80,7 +82,13 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
     g_autoptr(GString) out = g_string_new("");
 
-    if (do_inline || do_callback) {
+    if (do_trace) {
+        for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+            qemu_plugin_mem_trace_flush(trace, i);
+        }
+    }
+
+    if (do_inline || do_callback || do_trace) {
         g_string_printf(out, "mem accesses: %" PRIu64 "\n",
                         qemu_plugin_u64_sum(mem_count));
     }
@@ -115,6 +123,9 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     }
 
     qemu_plugin_scoreboard_free(counts);
+    if (trace) {
+        qemu_plugin_mem_trace_free(trace);
+    }
 }
 
 /*
@@ -253,6 +264,13 @@ static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
     }
 }
 
+static void vcpu_mem_trace(unsigned int cpu_index,
+                           const qemu_plugin_mem_record *records, size_t n,
+                           void *udata)
+{
+    qemu_plugin_u64_add(mem_count, cpu_index, n);
+}
+
 static void print_access(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
                          uint64_t vaddr, void *udata)
 {
@@ -305,6 +323,9 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
                 QEMU_PLUGIN_INLINE_ADD_U64,
                 mem_count, 1);
         }
+        if (do_trace) {
+            qemu_plugin_register_vcpu_mem_trace(insn, rw, trace);
+        }
         if (do_callback || do_region_summary) {
             qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem,
                                              QEMU_PLUGIN_CB_NO_REGS,
@@ -358,6 +379,11 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "trace") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &do_trace)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else if (g_strcmp0(tokens[0], "print-accesses") == 0) {
             if (!qemu_plugin_bool_parse(tokens[0], tokens[1],
                                         &do_print_accesses)) {
@@ -376,9 +402,10 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
         }
     }
 
-    if (do_inline && do_callback) {
+    if (do_inline + do_callback + do_trace > 1) {
         fprintf(stderr,
-                "can't enable inline and callback counting at the same time\n");
+                "can't enable more than one of inline, callback and trace "
+                "counting at the same time\n");
         return -1;
     }
 
@@ -399,6 +426,10 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
     mem_count = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, mem_count);
     io_count = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, io_count);
+    if (do_trace) {
+        trace = qemu_plugin_mem_trace_new(1024, vcpu_mem_trace,
+                                          QEMU_PLUGIN_CB_NO_REGS, NULL);
+    }
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
     return 0;
@@ -0,0 +1,98 @@
+/*
+ * Test the iova tree
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iova-tree.h"
+
+#define N_MAPS 64
+
+static DMAMap maps[N_MAPS];
+
+/* Reference lookup: lowest iova whose translated range overlaps the needle */
+static const DMAMap *ref_find_iova(const DMAMap *needle, const bool *present)
+{
+    const DMAMap *result = NULL;
+
+    for (int i = 0; i < N_MAPS; i++) {
+        const DMAMap *m = &maps[i];
+
+        if (!present[i] ||
+            m->translated_addr + m->size < needle->translated_addr ||
+            needle->translated_addr + needle->size < m->translated_addr) {
+            continue;
+        }
+        if (!result || m->iova < result->iova) {
+            result = m;
+        }
+    }
+
+    return result;
+}
+
+static void check_lookups(IOVATree *tree, const bool *present)
+{
+    for (int i = 0; i < 1000; i++) {
+        DMAMap needle = {
+            .translated_addr = g_test_rand_int_range(0, 0x110000),
+            .size = g_test_rand_int_range(0, 0x2000),
+        };
+        const DMAMap *ref = ref_find_iova(&needle, present);
+        const DMAMap *found = iova_tree_find_iova(tree, &needle);
+
+        if (!ref) {
+            g_assert_null(found);
+        } else {
+            g_assert_nonnull(found);
+            g_assert_cmphex(found->iova, ==, ref->iova);
+            g_assert_cmphex(found->translated_addr, ==, ref->translated_addr);
+        }
+    }
+}
+
+static void test_find_iova(void)
+{
+    g_autofree bool *present = g_new0(bool, N_MAPS);
+    IOVATree *tree = iova_tree_new();
+    uint64_t gen = iova_tree_generation(tree);
+
+    g_assert_null(iova_tree_find_iova(tree, &(DMAMap) { .size = 0x1000 }));
+
+    /* Translated ranges may overlap (aliases), iova ranges may not */
+    for (int i = 0; i < N_MAPS; i++) {
+        maps[i] = (DMAMap) {
+            .iova = (hwaddr)(N_MAPS - i) << 20,
+            .translated_addr = g_test_rand_int_range(0, 0x100000),
+            .size = g_test_rand_int_range(0, 0x8000),
+            .perm = IOMMU_RW,
+        };
+        g_assert_cmpint(iova_tree_insert(tree, &maps[i]), ==, IOVA_OK);
+        present[i] = true;
+        g_assert_cmpuint(iova_tree_generation(tree), !=, gen);
+        gen = iova_tree_generation(tree);
+    }
+    check_lookups(tree, present);
+
+    for (int i = 0; i < N_MAPS; i += 2) {
+        iova_tree_remove(tree, maps[i]);
+        present[i] = false;
+        g_assert_cmpuint(iova_tree_generation(tree), !=, gen);
+        gen = iova_tree_generation(tree);
+    }
+    check_lookups(tree, present);
+
+    iova_tree_destroy(tree);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/iova-tree/find-iova", test_find_iova);
+
+    return g_test_run();
+}
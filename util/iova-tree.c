@@ -10,12 +10,28 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/interval-tree.h"
 #include "qemu/iova-tree.h"
 
 struct IOVATree {
     GTree *tree;
+
+    /*
+     * Reverse index of the same maps keyed on their translated range, so
+     * iova_tree_find_iova() does not have to walk the whole tree.
+     */
+    IntervalTreeRoot taddr_tree;
+
+    /* Bumped on every insertion and removal */
+    uint64_t generation;
 };
 
+/* A mapping, as stored in both trees */
+typedef struct IOVATreeNode {
+    DMAMap map;                 /* GTree key, must be first */
+    IntervalTreeNode taddr;     /* [translated_addr, translated_addr + size] */
+} IOVATreeNode;
+
 /* Args to pass to iova_tree_alloc foreach function. */
 struct IOVATreeAllocArgs {
     /* Size of the desired allocation */
@@ -37,11 +53,6 @@ struct IOVATreeAllocArgs {
     bool iova_found;
 };
 
-typedef struct IOVATreeFindIOVAArgs {
-    const DMAMap *needle;
-    const DMAMap *result;
-} IOVATreeFindIOVAArgs;
-
 /**
  * Iterate args to the next hole
  *
@@ -86,33 +97,35 @@ const DMAMap *iova_tree_find(const IOVATree *tree, const DMAMap *map)
     return g_tree_lookup(tree->tree, map);
 }
 
-static gboolean iova_tree_find_address_iterator(gpointer key, gpointer value,
-                                                gpointer data)
+const DMAMap *iova_tree_find_iova(const IOVATree *tree, const DMAMap *map)
 {
-    const DMAMap *map = key;
-    IOVATreeFindIOVAArgs *args = data;
-    const DMAMap *needle;
+    /* The interval tree API takes no const root, but lookups don't modify */
+    IntervalTreeRoot *root = (IntervalTreeRoot *)&tree->taddr_tree;
+    uint64_t start = map->translated_addr;
+    uint64_t last = map->translated_addr + map->size;
+    const DMAMap *result = NULL;
+    IntervalTreeNode *it;
 
-    g_assert(key == value);
+    /*
+     * Translated ranges may alias.  Keep the lowest iova among the
+     * overlapping maps, the one an in-order walk of the iova tree would
+     * have returned first.
+     */
+    for (it = interval_tree_iter_first(root, start, last); it;
+         it = interval_tree_iter_next(it, start, last)) {
+        const DMAMap *cur = &container_of(it, IOVATreeNode, taddr)->map;
 
-    needle = args->needle;
-    if (map->translated_addr + map->size < needle->translated_addr ||
-        needle->translated_addr + needle->size < map->translated_addr) {
-        return false;
+        if (!result || cur->iova < result->iova) {
+            result = cur;
+        }
     }
 
-    args->result = map;
-    return true;
+    return result;
 }
 
-const DMAMap *iova_tree_find_iova(const IOVATree *tree, const DMAMap *map)
+uint64_t iova_tree_generation(const IOVATree *tree)
 {
-    IOVATreeFindIOVAArgs args = {
-        .needle = map,
-    };
-
-    g_tree_foreach(tree->tree, iova_tree_find_address_iterator, &args);
-    return args.result;
+    return tree->generation;
 }
 
 static inline void iova_tree_insert_internal(GTree *gtree, DMAMap *range)
@@ -123,7 +136,7 @@ static inline void iova_tree_insert_internal(GTree *gtree, DMAMap *range)
 
 int iova_tree_insert(IOVATree *tree, const DMAMap *map)
 {
-    DMAMap *new;
+    IOVATreeNode *new;
 
     if (map->iova + map->size < map->iova || map->perm == IOMMU_NONE) {
         return IOVA_ERR_INVALID;
@@ -134,9 +147,13 @@ int iova_tree_insert(IOVATree *tree, const DMAMap *map)
         return IOVA_ERR_OVERLAP;
     }
 
-    new = g_new0(DMAMap, 1);
-    memcpy(new, map, sizeof(*new));
-    iova_tree_insert_internal(tree->tree, new);
+    new = g_new0(IOVATreeNode, 1);
+    memcpy(&new->map, map, sizeof(new->map));
+    new->taddr.start = map->translated_addr;
+    new->taddr.last = map->translated_addr + map->size;
+    iova_tree_insert_internal(tree->tree, &new->map);
+    interval_tree_insert(&new->taddr, &tree->taddr_tree);
+    tree->generation++;
 
     return IOVA_OK;
 }
@@ -146,7 +163,11 @@ void iova_tree_remove(IOVATree *tree, DMAMap map)
     const DMAMap *overlap;
 
     while ((overlap = iova_tree_find(tree, &map))) {
+        IOVATreeNode *node = container_of(overlap, IOVATreeNode, map);
+
+        interval_tree_remove(&node->taddr, &tree->taddr_tree);
         g_tree_remove(tree->tree, overlap);
+        tree->generation++;
     }
 }
 